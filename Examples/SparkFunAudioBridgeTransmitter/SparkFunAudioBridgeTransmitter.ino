@@ -12,53 +12,85 @@ us at the local.
 Code developed in Arduino 1.0.5, on an Arduino Pro Mini 3.3V.
 ****************************************************************/
 
-// Include the two libraries we need to use this; I'm using a software serial port
+// Include the libraries we need to use this; I'm using a software serial port
 //  because time-sharing the hardware port with uploading code is a pain.
 #include <SparkFunbc127.h>
+#include <SparkFunbc127reconnect.h>
 #include <SoftwareSerial.h>
 
 // Create a software serial port.
 SoftwareSerial swPort(11,10);  // RX, TX
 // Create a BC127 and attach the software serial port to it.
 BC127 BTModu(&swPort);
+// The reconnect manager remembers who we were connected to and gets us back
+//  there when the link drops, without tying up loop() while it does it.
+BC127Reconnect reconnect(&BTModu);
 
 String address = "20FABB0101CF"; // Remote module's address. If I were an optimist,
                                  //  I'd scan for BC127 modules and treat any one I
                                  //  found as the remote. Let's hard code for safety.
 
+// Put the module into a known configuration. The reconnect manager only calls
+//  this if simply reconnecting, and then resetting, haven't worked.
+void configureSource(BC127 *module)
+{
+  // Blast the existing settings of the BC127 module, so I know that the module is
+  //  set to factory defaults...
+  module->restore();
+  
+  // ...but, before I restart, I need to set the device to be a SOURCE, so it will
+  //  enable its audio input and forward the data to the remote.
+  module->setClassicSource();
+  
+  // Write, reset, to commit and effect the change to a source.
+  module->writeConfig();
+  module->reset();
+}
+
 void setup()
 {
   // Serial port configuration. The software port should be at 9600 baud, as that
   //  is the default speed for the BC127.
   Serial.begin(9600);
   swPort.begin(9600);
+  
+  reconnect.setReconfigure(configureSource);
 }
 
 void loop()
 {
   // Loop doesn't have to do much...just monitor the connection and try and restore
-  //  it if it's lost.
-  if (BTModu.connectionState() == BC127::CONNECT_ERROR)
+  //  it if it's lost. While the reconnect manager is busy, we leave the module
+  //  alone; the rest of loop() keeps running, though.
+  static BC127Reconnect::reconnectState lastState = BC127Reconnect::IDLE;
+  BC127Reconnect::reconnectState state = reconnect.update();
+  
+  // If we just got the connection back, use the "PLAY" command to start the
+  //  devices streaming audio again.
+  if (state == BC127Reconnect::CONNECTED && lastState != BC127Reconnect::CONNECTED)
   {
-    // Blast the existing settings of the BC127 module, so I know that the module is
-    //  set to factory defaults...
-    BTModu.restore();
-    
-    // ...but, before I restart, I need to set the device to be a SOURCE, so it will
-    //  enable its audio input and forward the data to the remote.
-    BTModu.setClassicSource();
-    
-    // Write, reset, to commit and effect the change to a source.
-    BTModu.writeConfig();
-    BTModu.reset();
-    
-    // Now, attempt to connect. There are timeouts on these operations, so we won't
-    //  sit forever.
-    BTModu.connect(address, BC127::A2DP);
-    BTModu.connect(address, BC127::AVRCP);
-    // If we DID connect, we want to use the "PLAY" command to start the devices
-    //  streaming audio. If we didn't, well, who cares? No harm in a spurious "PLAY".
+    Serial.print("Reconnected in "); Serial.print(reconnect.lastRecoveryTime());
+    Serial.println("ms");
     BTModu.musicCommands(BC127::PLAY);
   }
+  lastState = state;
+  if (state != BC127Reconnect::IDLE && state != BC127Reconnect::CONNECTED) return;
+  
+  if (BTModu.connectionState() == BC127::CONNECT_ERROR)
+  {
+    // If we've been connected before, the reconnect manager knows what to do.
+    if (BTModu.lastProfiles() != 0) reconnect.linkLost();
+    else
+    {
+      // Otherwise, this is our first time through; configure the module, then
+      //  attempt to connect. There are timeouts on these operations, so we
+      //  won't sit forever.
+      configureSource(&BTModu);
+      BTModu.connect(address, BC127::A2DP);
+      BTModu.connect(address, BC127::AVRCP);
+      // If we DID connect, we want to use the "PLAY" command to start the devices
+      //  streaming audio. If we didn't, well, who cares? No harm in a spurious "PLAY".
+      BTModu.musicCommands(BC127::PLAY);
+    }
+  }
 }
-
@@ -14,12 +14,19 @@ Code developed in Arduino 1.0.5, on an Arduino Pro Mini 3.3V.
 // Include the two libraries we need to use this; I'm using a software serial port
 //  because time-sharing the hardware port with uploading code is a pain.
 #include <SparkFunbc127.h>
+#include <SparkFunbc127peers.h>
+#include <SparkFunbc127eepromstore.h>
 #include <SoftwareSerial.h>
+#include <EEPROM.h>
 
 // Create a software serial port.
 SoftwareSerial swPort(3,2);  // RX, TX
 // Create a BC127 and attach the software serial port to it.
 BC127 BTModu(&swPort);
+// Remember the boards we've paired with in EEPROM, starting at address 0, so
+//  we don't have to go looking for them again after a power cycle.
+BC127EEPROMStore peerStore(0);
+BC127PeerCache knownPeers(&BTModu, &peerStore);
 
 // Aliases for the input and output pins we're going to use.
 #define POTPIN    A0
@@ -33,6 +40,7 @@ void setup()
   //  is the default speed for the BC127.
   Serial.begin(9600);
   swPort.begin(9600);
+  knownPeers.begin();
   
   // Blast the existing settings of the BC127 module, so I know that the module is
   //  set to factory defaults.
@@ -172,6 +180,9 @@ int linearizeLED(int potVal)
 int BC127Connect()
 {
   int connectionResult = BC127::REMOTE_ERROR; // Our return value. Assume failure.
+  // If we've connected to a board before, try that first; it takes a fraction
+  //  of the time an inquiry does.
+  if (knownPeers.connectKnown() == BC127::SUCCESS) return BTModu.enterDataMode();
   BTModu.inquiry(10);   // Spend 13 seconds seeking local devices.
   String address;   // Buffer for addresses we've found.
   // This loop will scan through the addresses found (there will be a maximum of
@@ -193,7 +204,9 @@ int BC127Connect()
   // Okay, hopefully, by now we've found and connected to a BC127. If not, return
   //  an error...
   if (connectionResult != BC127::SUCCESS) return connectionResult;
-  // ...but, if so, we want to try to enter data mode.
-  else connectionResult = BTModu.enterDataMode();
+  // ...but, if so, we want to remember this board for next time, and try to
+  //  enter data mode.
+  knownPeers.rememberLast();
+  connectionResult = BTModu.enterDataMode();
   return connectionResult;
 }
@@ -0,0 +1,80 @@
+/****************************************************************
+Just enough of the Arduino core to build the library on a PC, for
+the host tests in this directory. See README.md.
+
+This code is beerware; if you use it, please buy me (or any other
+SparkFun employee) a cold beverage next time you run into one of
+us at the local.
+****************************************************************/
+
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+// There's no separate flash on a PC, so the PROGMEM functions are just the
+//  ordinary ones.
+#define PROGMEM
+#define PGM_P const char *
+#define PSTR(s) (s)
+class __FlashStringHelper;
+#define F(s) (reinterpret_cast<const __FlashStringHelper *>(PSTR(s)))
+#define pgm_read_byte(p) (*(const uint8_t *)(p))
+#define pgm_read_ptr(p) (*(void * const *)(p))
+#define strlen_P strlen
+#define strncmp_P strncmp
+#define memcpy_P memcpy
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+// Simulated time. Every call to millis() moves the clock on by a quarter of
+//  a millisecond, so the library's timeout loops always finish, and the
+//  simulated modules (see sim_module.h) can schedule their replies against
+//  the same clock. hostNow() reads it without moving it.
+unsigned long millis();
+unsigned long hostNow();
+void delay(unsigned long ms);
+void hostResetClock();
+long random(long howBig);
+
+// The library only needs a String it can build and read back.
+class String
+{
+  public:
+    String() {}
+    String(const char *c) : _s(c ? c : "") {}
+    String &operator=(const char *c) { _s = c ? c : ""; return *this; }
+    const char *c_str() const { return _s.c_str(); }
+    unsigned int length() const { return _s.size(); }
+  private:
+    std::string _s;
+};
+
+class Print
+{
+  public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t *buffer, size_t size)
+    {
+      size_t n = 0;
+      while (size--) n += write(*buffer++);
+      return n;
+    }
+    virtual void flush() {}
+};
+
+class Stream : public Print
+{
+  public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+};
+
+#endif
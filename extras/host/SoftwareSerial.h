@@ -0,0 +1,15 @@
+/****************************************************************
+Stand-in for the Arduino SoftwareSerial header, so SparkFunbc127.h
+builds on a PC. The host tests never use it.
+
+This code is beerware; if you use it, please buy me (or any other
+SparkFun employee) a cold beverage next time you run into one of
+us at the local.
+****************************************************************/
+
+#ifndef HOST_SOFTWARESERIAL_H
+#define HOST_SOFTWARESERIAL_H
+
+#include <Arduino.h>
+
+#endif
@@ -0,0 +1,237 @@
+/****************************************************************
+Checks that the const char* and F("...") side of the library never
+touches the heap. Every operator new is counted while the library
+runs a command against a simulated module; anything but zero is a
+failure.
+
+This code is beerware; if you use it, please buy me (or any other
+SparkFun employee) a cold beverage next time you run into one of
+us at the local.
+****************************************************************/
+
+#include <new>
+#include <stdio.h>
+#include <Arduino.h>
+#include "sim_module.h"
+#include "SparkFunbc127.h"
+#include "SparkFunbc127group.h"
+#include "SparkFunbc127health.h"
+#include "SparkFunbc127remote.h"
+
+static boolean counting = false;
+static unsigned int allocations = 0;
+
+void *operator new(size_t size)
+{
+  if (counting) allocations++;
+  void *p = malloc(size ? size : 1);
+  if (p == NULL) throw std::bad_alloc();
+  return p;
+}
+
+void *operator new[](size_t size)
+{
+  return operator new(size);
+}
+
+void operator delete(void *p) noexcept
+{
+  free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+  free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+  free(p);
+}
+
+void operator delete[](void *p, size_t) noexcept
+{
+  free(p);
+}
+
+// Answers to everything the tests below send.
+class AllocModule : public SimModule
+{
+  protected:
+    virtual boolean reply(const char *command)
+    {
+      if (startsWith(command, "GET NAME"))
+        queueReply("NAME=Purpletooth Jamboree\n\rOK\n\r", 10);
+      else if (startsWith(command, "GET LOCAL_ADDR"))
+        queueReply("LOCAL_ADDR=20FABB0101CF\n\rOK\n\r", 10);
+      else if (startsWith(command, "STATUS"))
+        queueReply("STATE CONNECTED\n\rLINK 10 CONNECTED A2DP 20FABB010272\n\r"
+                   "OK\n\r", 10);
+      else if (startsWith(command, "OPEN"))
+        queueReply("OPEN_OK 10 SPP 20FABB010272\n\r", 20);
+      else if (startsWith(command, "RESET"))
+        queueReply("BlueCreation Copyright 2013\n\rMelody Audio V5.0 RC9\n\r"
+                   "Ready\n\r", 300);
+      else if (startsWith(command, "INQUIRY"))
+      {
+        queueReply("INQUIRY 20FABB010272 240404 -54dB\n\r", 100);
+        queueReply("INQUIRY A4D1D203A4F4 7a020c -67dB\n\r", 100);
+        queueReply("OK\n\r", 100);
+      }
+      else if (startsWith(command, "SCAN"))
+      {
+        queueReply("SCAN 20FABB0101CF <Purpletooth> 0A -61\n\r", 100);
+        queueReply("OK\n\r", 100);
+      }
+      else return false;
+      return true;
+    }
+};
+
+static int failures = 0;
+
+static void check(const char *name, int result, int expected)
+{
+  unsigned int count = allocations;
+  counting = false;
+  allocations = 0;
+  boolean ok = (count == 0 && result == expected);
+  if (!ok) failures++;
+  printf("  %-34s result %3d  allocations %u%s\n", name, result, count,
+         ok ? "" : "  <-- FAIL");
+}
+
+#define RUN(name, call, expected) \
+  do { counting = true; int r_ = (call); check(name, r_, expected); } while (0)
+
+// Poll a non-blocking command to the end, counting all the way.
+static int finish(BC127 &module, BC127::opResult result)
+{
+  while (result == BC127::IN_PROGRESS) result = module.asyncPoll();
+  return result;
+}
+
+template <class Module>
+static void blockingCalls(Module &bt)
+{
+  char buffer[BC127::LINE_BUF_LEN];
+
+  RUN("reset()", bt.reset(), BC127::SUCCESS);
+  RUN("stdCmd(const char *)", bt.stdCmd("STATUS"), BC127::SUCCESS);
+  RUN("stdCmd(F())", bt.stdCmd(F("STATUS")), BC127::SUCCESS);
+  RUN("stdSetParam(const char *)", bt.stdSetParam("NAME", "Jamboree"),
+      BC127::SUCCESS);
+  RUN("stdSetParam(F())", bt.stdSetParam(F("NAME"), "Jamboree"),
+      BC127::SUCCESS);
+  RUN("stdGetParam(const char *)",
+      bt.stdGetParam("NAME", buffer, sizeof(buffer)), BC127::SUCCESS);
+  RUN("stdGetParam(F())", bt.stdGetParam(F("NAME"), buffer, sizeof(buffer)),
+      BC127::SUCCESS);
+  RUN("addressQuery(char *)", bt.addressQuery(buffer), BC127::SUCCESS);
+  RUN("restore()", bt.restore(), BC127::SUCCESS);
+  RUN("writeConfig()", bt.writeConfig(), BC127::SUCCESS);
+  RUN("setBaudRate()", bt.setBaudRate(BC127::s9600bps), BC127::SUCCESS);
+  RUN("connect(const char *)", bt.connect("20FABB010272", BC127::SPP),
+      BC127::SUCCESS);
+  RUN("connectionState()", bt.connectionState(), BC127::SUCCESS);
+#if BC127_ENABLE_AUDIO
+  RUN("musicCommands()", bt.musicCommands(BC127::PLAY), BC127::SUCCESS);
+  RUN("setVolume()", bt.setVolume(9), BC127::SUCCESS);
+  RUN("setClassicSink()", bt.setClassicSink(), BC127::SUCCESS);
+#endif
+#if BC127_ENABLE_CLASSIC_DISCOVERY
+  RUN("inquiry()", bt.inquiry(2), 2);
+  RUN("getAddress(char, char *)", bt.getAddress((char)1, buffer), BC127::SUCCESS);
+  RUN("connect(char)", bt.connect((char)0, BC127::SPP), BC127::SUCCESS);
+#endif
+#if BC127_ENABLE_BLE
+  RUN("BLEScan()", bt.BLEScan(2), 1);
+  RUN("BLEAdvertise()", bt.BLEAdvertise(), BC127::SUCCESS);
+#endif
+#if BC127_ENABLE_DATA_MODE
+  RUN("enterDataMode()", bt.enterDataMode(), BC127::SUCCESS);
+  RUN("exitDataMode()", bt.exitDataMode(), BC127::SUCCESS);
+#endif
+}
+
+int main()
+{
+  char buffer[BC127::LINE_BUF_LEN];
+
+  printf("BC127, blocking calls:\n");
+  AllocModule simA;
+  BC127 btA(&simA);
+  blockingCalls(btA);
+
+  printf("BC127Port<AllocModule>, blocking calls:\n");
+  AllocModule simB;
+  BC127Port<AllocModule> btB(&simB);
+  blockingCalls(btB);
+
+  printf("BC127, non-blocking calls:\n");
+  RUN("stdCmdAsync(const char *)", finish(btA, btA.stdCmdAsync("STATUS")),
+      BC127::SUCCESS);
+  RUN("stdCmdAsync(F())", finish(btA, btA.stdCmdAsync(F("STATUS"))),
+      BC127::SUCCESS);
+  RUN("stdGetParamAsync(F())", finish(btA, btA.stdGetParamAsync(F("NAME"),
+      buffer, sizeof(buffer))), BC127::SUCCESS);
+  RUN("connectAsync()", finish(btA, btA.connectAsync("20FABB010272",
+      BC127::SPP)), BC127::SUCCESS);
+  RUN("connectionStateAsync()", finish(btA, btA.connectionStateAsync()),
+      BC127::SUCCESS);
+  RUN("resetAsync()", finish(btA, btA.resetAsync()), BC127::SUCCESS);
+  RUN("pingAsync()", finish(btA, btA.pingAsync(50)), BC127::SUCCESS);
+#if BC127_ENABLE_AUDIO
+  RUN("musicCommandsAsync()", finish(btA, btA.musicCommandsAsync(
+      BC127::PAUSE)), BC127::SUCCESS);
+  RUN("setVolumeAsync()", finish(btA, btA.setVolumeAsync(4)),
+      BC127::SUCCESS);
+#endif
+#if BC127_ENABLE_CLASSIC_DISCOVERY
+  RUN("inquiryAsync()", finish(btA, btA.inquiryAsync(2)), 2);
+#endif
+
+  // The helpers are built first (their constructors are allowed to do what
+  //  they like), then run for a few simulated seconds.
+  printf("Helpers, 5 s of simulated time each:\n");
+  BC127Group group;
+  group.add(&btA);
+  group.add(&btB);
+  counting = true;
+  for (unsigned long end = millis() + 5000; millis() < end; )
+  {
+    if (group.pending(0) < 2) group.stdCmd(0, F("STATUS"));
+    if (group.pending(1) < 2) group.stdGetParam(1, F("NAME"), buffer,
+                                                sizeof(buffer));
+    group.poll();
+  }
+  while (!group.idle()) group.poll();
+  check("BC127Group", group.failed(), 0);
+
+  BC127Health health(&btA);
+  health.setProbe(100, 50);
+  counting = true;
+  for (unsigned long end = millis() + 5000; millis() < end; ) health.update();
+  // Let the last probe finish, or nobody else can use the module.
+  while (btA.asyncBusy()) health.update();
+  check("BC127Health", health.outages(), 0);
+
+#if BC127_ENABLE_AUDIO
+  BC127Remote remote(&btA);
+  counting = true;
+  unsigned long nextPress = millis();
+  for (unsigned long end = millis() + 5000; millis() < end; )
+  {
+    if (millis() >= nextPress)
+    {
+      remote.press((nextPress / 50) % 3 ? BC127::UP : BC127::DOWN);
+      nextPress += 50;
+    }
+    remote.update();
+  }
+  check("BC127Remote", remote.commandsSent() > 0, 1);
+#endif
+
+  printf(failures ? "FAILED: %d\n" : "All clear.\n", failures);
+  return failures ? 1 : 0;
+}
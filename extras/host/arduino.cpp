@@ -0,0 +1,38 @@
+/****************************************************************
+The simulated clock and the other Arduino core functions the library
+calls, for the host tests. See Arduino.h.
+
+This code is beerware; if you use it, please buy me (or any other
+SparkFun employee) a cold beverage next time you run into one of
+us at the local.
+****************************************************************/
+
+#include <Arduino.h>
+
+// In quarter milliseconds.
+static unsigned long ticks = 0;
+
+unsigned long millis()
+{
+  return ticks++ / 4;
+}
+
+unsigned long hostNow()
+{
+  return ticks / 4;
+}
+
+void delay(unsigned long ms)
+{
+  ticks += ms * 4;
+}
+
+void hostResetClock()
+{
+  ticks = 0;
+}
+
+long random(long howBig)
+{
+  return howBig ? rand() % howBig : 0;
+}
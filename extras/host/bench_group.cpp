@@ -0,0 +1,121 @@
+/****************************************************************
+Throughput of BC127Group against module count, compared with
+calling the blocking functions on each module in turn.
+
+This code is beerware; if you use it, please buy me (or any other
+SparkFun employee) a cold beverage next time you run into one of
+us at the local.
+****************************************************************/
+
+#include <stdio.h>
+#include <Arduino.h>
+#include "sim_module.h"
+#include "SparkFunbc127.h"
+#include "SparkFunbc127group.h"
+
+// Each module answers STATUS in 20ms. An inquiry finds one device after
+//  1.5 seconds and finishes after 3.
+class GroupModule : public SimModule
+{
+  protected:
+    virtual boolean reply(const char *command)
+    {
+      if (!startsWith(command, "INQUIRY")) return false;
+      queueReply("INQUIRY 20FABB010272 240404 -54dB\n\r", 1500);
+      queueReply("OK\n\r", 1500);
+      return true;
+    }
+};
+
+static const unsigned long WINDOW = 10000;
+
+// Four simulated modules, each with its own BC127, built fresh for every run.
+struct Bench
+{
+  Bench() : m0(&sims[0]), m1(&sims[1]), m2(&sims[2]), m3(&sims[3])
+  {
+    modules[0] = &m0;
+    modules[1] = &m1;
+    modules[2] = &m2;
+    modules[3] = &m3;
+  }
+
+  enum {MODULES = 4};
+  GroupModule sims[MODULES];
+  BC127 m0, m1, m2, m3;
+  BC127 *modules[MODULES];
+};
+
+// Module 0 starts with an inquiry (if the library has it); after that, every
+//  module gets STATUS after STATUS for ten seconds. Returns commands completed
+//  per second.
+static float blocking(byte count)
+{
+  Bench bench;
+  BC127 **modules = bench.modules;
+
+  hostResetClock();
+  unsigned long start = millis();
+  unsigned int done = 0;
+#if BC127_ENABLE_CLASSIC_DISCOVERY
+  modules[0]->inquiry(4);
+#endif
+  while (millis() - start < WINDOW)
+  {
+    for (byte i = 0; i < count; i++)
+      if (modules[i]->stdCmd("STATUS") == BC127::SUCCESS) done++;
+  }
+  return done * 1000.0 / WINDOW;
+}
+
+static float grouped(byte count, unsigned long &avgLatency,
+                     unsigned long &maxLatency, unsigned int &failed)
+{
+  Bench bench;
+  BC127Group group;
+  for (byte i = 0; i < count; i++) group.add(bench.modules[i]);
+
+  hostResetClock();
+  unsigned long start = millis();
+#if BC127_ENABLE_CLASSIC_DISCOVERY
+  group.inquiry(0, 4);
+#endif
+  while (millis() - start < WINDOW)
+  {
+    for (byte i = 0; i < count; i++)
+      while (group.pending(i) < BC127_GROUP_QUEUE_LEN) group.stdCmd(i, "STATUS");
+    group.poll();
+  }
+
+  avgLatency = group.averageLatency();
+  maxLatency = group.maxLatency();
+  failed = group.failed();
+  return group.completed() * 1000.0 / WINDOW;
+}
+
+int main()
+{
+  int status = 0;
+  float last = 0;
+
+  printf("modules  blocking cmd/s  group cmd/s  group avg/max latency\n");
+  for (byte count = 1; count <= Bench::MODULES && count <= BC127_GROUP_SIZE;
+       count++)
+  {
+    unsigned long avgLatency, maxLatency;
+    unsigned int failed;
+    float slow = blocking(count);
+    float fast = grouped(count, avgLatency, maxLatency, failed);
+    printf("%7u  %14.1f  %11.1f  %lu/%lu ms\n", count, slow, fast, avgLatency,
+           maxLatency);
+
+    // The whole point: no failures, and more modules, more work done.
+    if (failed != 0 || fast <= last || fast < slow)
+    {
+      printf("  <-- FAIL (%u failed)\n", failed);
+      status = 1;
+    }
+    last = fast;
+  }
+  return status;
+}
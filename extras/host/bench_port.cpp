@@ -0,0 +1,134 @@
+/****************************************************************
+Time spent per byte received, for a BC127 talking to its port
+through Stream's virtual functions, and for a BC127Port that knows
+the port's type. Build this one with -O2; without optimization
+there's nothing for BC127Port to gain.
+
+This code is beerware; if you use it, please buy me (or any other
+SparkFun employee) a cold beverage next time you run into one of
+us at the local.
+****************************************************************/
+
+#include <stdio.h>
+#include <time.h>
+#include <Arduino.h>
+#include "SparkFunbc127.h"
+
+// A port with no timing at all: every reply can be read the moment the
+//  command's "\r" goes out, so the receive loops never wait, and all that's
+//  measured is the cost of getting bytes from the port into the line buffer.
+//  An empty line gets "ERROR"; anything else gets a STATUS-style reply of
+//  ten lines.
+class FastPort : public Stream
+{
+  public:
+    FastPort() : received(0), _reply(""), _next(NULL), _end(NULL),
+                 _cmdLen(0) {}
+
+    unsigned long received;
+
+    virtual int available()
+    {
+      return _next == NULL ? 0 : (int)(_end - _next);
+    }
+    virtual int read()
+    {
+      if (_next == NULL || _next == _end) return -1;
+      received++;
+      return *_next++;
+    }
+    virtual int peek()
+    {
+      if (_next == NULL || _next == _end) return -1;
+      return *_next;
+    }
+    virtual size_t write(uint8_t c)
+    {
+      if (c != '\r')
+      {
+        _cmdLen++;
+        return 1;
+      }
+      _reply = _cmdLen == 0 ? "ERROR\n\r" : STATUS_REPLY;
+      _next = _reply;
+      _end = _reply + strlen(_reply);
+      _cmdLen = 0;
+      return 1;
+    }
+    using Print::write;
+
+  private:
+    static const char STATUS_REPLY[];
+    const char *_reply;
+    const char *_next;
+    const char *_end;
+    unsigned int _cmdLen;
+};
+
+const char FastPort::STATUS_REPLY[] =
+  "STATE CONNECTED\n\r"
+  "LINK 10 CONNECTED A2DP 20FABB010272 STREAMING\n\r"
+  "LINK 11 CONNECTED AVRCP 20FABB010272 PLAYING\n\r"
+  "LINK 12 CONNECTED HFP 20FABB010272\n\r"
+  "LINK 13 CONNECTED SPP 20FABB010273\n\r"
+  "LINK 14 CONNECTED BLE 20FABB010274\n\r"
+  "AVRCP_MEDIA TITLE: Some song with a long enough name\n\r"
+  "AVRCP_MEDIA ARTIST: Somebody or other\n\r"
+  "AVRCP_MEDIA ALBUM: The one with that song on it\n\r"
+  "OK\n\r";
+
+static const unsigned int COMMANDS = 20000;
+
+static double seconds()
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+// Send STATUS over and over, and return nanoseconds per byte received. Any
+//  command that doesn't succeed is counted in failed.
+static double run(BC127 &bt, FastPort &port, unsigned int &failed)
+{
+  // One to warm up.
+  bt.stdCmd("STATUS");
+  port.received = 0;
+  failed = 0;
+  double start = seconds();
+  for (unsigned int i = 0; i < COMMANDS; i++)
+  {
+    if (bt.stdCmd("STATUS") != BC127::SUCCESS) failed++;
+  }
+  return (seconds() - start) * 1e9 / port.received;
+}
+
+int main()
+{
+  int status = 0;
+
+  FastPort streamPort;
+  BC127 streamModule(&streamPort);
+  unsigned int streamFailed;
+  double streamTime = run(streamModule, streamPort, streamFailed);
+
+  FastPort templatePort;
+  BC127Port<FastPort> templateModule(&templatePort);
+  unsigned int templateFailed;
+  double templateTime = run(templateModule, templatePort, templateFailed);
+
+  printf("%u STATUS commands, %lu bytes received by each module\n",
+         COMMANDS, streamPort.received);
+  printf("  BC127 (Stream *)      %6.1f ns/byte\n", streamTime);
+  printf("  BC127Port<FastPort>   %6.1f ns/byte\n", templateTime);
+  printf("  ratio                 %6.2f\n", streamTime / templateTime);
+
+  // The timings depend on the machine; all we can insist on is that every
+  //  command worked, and that both saw the same bytes.
+  if (streamFailed != 0 || templateFailed != 0 ||
+      streamPort.received != templatePort.received)
+  {
+    printf("  <-- FAIL (%u and %u failed)\n", streamFailed, templateFailed);
+    status = 1;
+  }
+  return status;
+}
@@ -0,0 +1,125 @@
+/****************************************************************
+Checks what the library makes of a simulated module booting: the
+version it picks out of the banner, how long it says the boot took,
+and when it says the first command went out.
+
+This code is beerware; if you use it, please buy me (or any other
+SparkFun employee) a cold beverage next time you run into one of
+us at the local.
+****************************************************************/
+
+#include <stdio.h>
+#include <Arduino.h>
+#include "sim_module.h"
+#include "SparkFunbc127.h"
+
+static int failures = 0;
+
+// Print a measurement, and fail unless it's between low and high.
+static void check(const char *name, long value, long low, long high)
+{
+  boolean ok = (value >= low && value <= high);
+  if (!ok) failures++;
+  printf("  %-44s %6ld%s\n", name, value, ok ? "" : "  <-- FAIL");
+}
+
+// Answers RESET with a banner, 700 ms from start to "Ready". For quiet ms
+//  after that, it ignores everything, as a module that's still settling
+//  might.
+class BootModule : public SimModule
+{
+  public:
+    BootModule() : quiet(0), _quietUntil(0) {}
+
+    unsigned long quiet;
+
+  protected:
+    virtual boolean reply(const char *command)
+    {
+      if (hostNow() < _quietUntil) return true;
+      if (!startsWith(command, "RESET")) return false;
+      queueReply("BlueCreation Copyright 2013\n\r", 200);
+      queueReply("Melody Audio V5.0 RC9\n\r", 100);
+      queueReply("Build 1234\n\r", 100);
+      queueReply("Ready\n\r", 300);
+      _quietUntil = hostNow() + 700 + quiet;
+      return true;
+    }
+
+  private:
+    unsigned long _quietUntil;
+};
+
+// Everything the banner has to say, and the boot time, from a blocking reset.
+static void banner()
+{
+  printf("Boot banner:\n");
+  BootModule sim;
+  BC127 bt(&sim);
+  check("reset()", bt.reset(), BC127::SUCCESS, BC127::SUCCESS);
+  check("bootTime() (ms)", bt.bootTime(), 700, 705);
+  check("firmwareVersion() is \"V5.0 RC9\"",
+        strcmp(bt.firmwareVersion(), "V5.0 RC9") == 0, 1, 1);
+  check("firmwareMajor()", bt.firmwareMajor(), 5, 5);
+  check("firmwareMinor()", bt.firmwareMinor(), 0, 0);
+  check("firmwareBuild()", bt.firmwareBuild(), 1234, 1234);
+}
+
+// The sketch leaves the module half a second after "Ready", then sends a
+//  command, blocking or not. Either way, what's reported is when the command
+//  itself went out; the blocking one waits for the answer to its empty line
+//  first, so it's a few ms later.
+static void firstCommand()
+{
+  printf("First command, 500 ms after Ready:\n");
+  BootModule simA;
+  BC127 btA(&simA);
+  btA.reset();
+  delay(500);
+  btA.stdCmd("STATUS");
+  long blocking = btA.bootToFirstCommand() - btA.bootTime();
+  check("blocking: after Ready (ms)", blocking, 500, 510);
+
+  BootModule simB;
+  BC127 btB(&simB);
+  btB.resetAsync();
+  while (btB.asyncPoll() == BC127::IN_PROGRESS) {}
+  delay(500);
+  btB.stdCmdAsync("STATUS");
+  while (btB.asyncPoll() == BC127::IN_PROGRESS) {}
+  long async = btB.bootToFirstCommand() - btB.bootTime();
+  check("non-blocking: after Ready (ms)", async, 500, 505);
+  check("difference (ms)", blocking - async, 0, 10);
+}
+
+// The module says "Ready" but ignores the first command's empty line. That
+//  command never goes out, so it mustn't be counted as the first.
+static void firstCommandIgnored()
+{
+  printf("First command lost while the module settles:\n");
+  BootModule sim;
+  sim.quiet = 300;
+  BC127 bt(&sim);
+  bt.reset();
+  unsigned int sent = sim.commands;
+  check("stdCmd() right after Ready", bt.stdCmd("STATUS"),
+        BC127::TIMEOUT_ERROR, BC127::TIMEOUT_ERROR);
+  check("  lines sent (just the empty one)", sim.commands - sent, 1, 1);
+  check("  bootToFirstCommand()", bt.bootToFirstCommand(), 0, 0);
+
+  delay(400);
+  check("stdCmd() 400 ms later", bt.stdCmd("STATUS"), BC127::SUCCESS,
+        BC127::SUCCESS);
+  // 100 ms waiting on the first empty line, then the 400 ms delay.
+  check("  bootToFirstCommand() after Ready (ms)",
+        bt.bootToFirstCommand() - bt.bootTime(), 500, 510);
+}
+
+int main()
+{
+  banner();
+  firstCommand();
+  firstCommandIgnored();
+  printf(failures ? "FAILED: %d\n" : "All clear.\n", failures);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,233 @@
+/****************************************************************
+Checks what BC127Health and the offline machinery actually do when
+a simulated module hangs: how long it takes to notice, how long the
+calls made in the meantime take to fail, and how quickly everything
+comes back.
+
+This code is beerware; if you use it, please buy me (or any other
+SparkFun employee) a cold beverage next time you run into one of
+us at the local.
+****************************************************************/
+
+#include <stdio.h>
+#include <Arduino.h>
+#include "sim_module.h"
+#include "SparkFunbc127.h"
+#include "SparkFunbc127health.h"
+
+static int failures = 0;
+
+// Print a measurement, and fail unless it's between low and high.
+static void check(const char *name, long value, long low, long high)
+{
+  boolean ok = (value >= low && value <= high);
+  if (!ok) failures++;
+  printf("  %-44s %6ld%s\n", name, value, ok ? "" : "  <-- FAIL");
+}
+
+// How long a blocking call took, on the simulated clock.
+static unsigned long started;
+#define TIMED(call) (started = hostNow(), (call), (long)(hostNow() - started))
+
+static void run(BC127Health &health, unsigned long time)
+{
+  for (unsigned long end = millis() + time; millis() < end; ) health.update();
+}
+
+// A sketch that talks to the module regularly keeps it out of trouble: each
+//  reply is a sign of life, so no probes are needed.
+static void busyModule()
+{
+  printf("A module in regular use:\n");
+  SimModule sim;
+  BC127 bt(&sim);
+  BC127Health health(&bt);
+
+  for (byte i = 0; i < 30; i++)
+  {
+    bt.stdCmd("STATUS");
+    run(health, 100);
+  }
+  check("probes in three seconds", health.probes(), 0, 0);
+  check("state", health.state(), BC127Health::HEALTHY, BC127Health::HEALTHY);
+}
+
+static unsigned int resetPulses;
+
+static void resetHook(BC127 *module)
+{
+  (void)module;
+  resetPulses++;
+}
+
+// The module hangs while nothing else is going on, so it's up to the probes.
+//  With the default timing, it's noticed one idle time plus one probe timeout
+//  after we last heard from it, and found again within one retry time of
+//  coming back. The reset line is pulsed when it goes down, and after every
+//  four failed retries.
+static void hangWhileIdle()
+{
+  printf("Hang found by the monitor:\n");
+  SimModule sim;
+  BC127 bt(&sim);
+  BC127Health health(&bt);
+  health.setRetry(250, 4);
+  resetPulses = 0;
+  health.setResetHook(resetHook);
+  run(health, 3000);
+  check("probes while healthy", health.probes(), 2, 3);
+  check("probe time (ms)", health.maxProbeTime(), 1, 5);
+
+  sim.hung = true;
+  while (health.update() != BC127Health::DOWN) {}
+  check("detection time (ms)", health.lastDetectionTime(), 1000, 1060);
+  check("  offline", bt.offline(), 1, 1);
+  check("  reset pulses", resetPulses, 1, 1);
+
+  // Two seconds down: 8 failed retries, so two more pulses.
+  run(health, 2000);
+  check("reset pulses after two seconds", resetPulses, 3, 3);
+  sim.hung = false;
+  while (health.update() != BC127Health::HEALTHY) {}
+  check("downtime (ms)", health.lastDowntime(), 2000, 2260);
+  check("  total", health.totalDowntime(), health.lastDowntime(),
+        health.lastDowntime());
+  check("  offline", bt.offline(), 0, 0);
+  check("outages", health.outages(), 1, 1);
+}
+
+// The module hangs while the sketch is busy with blocking calls, before the
+//  monitor has had a chance to notice. The first call finds out in the time
+//  it takes to send an empty line and hear nothing, and doesn't send its
+//  command; everything after that fails at once.
+static void hangDuringCalls()
+{
+  printf("Hang found by a blocking call, with a monitor:\n");
+  SimModule sim;
+  BC127 bt(&sim);
+  BC127Health health(&bt);
+  run(health, 2000);
+
+  sim.hung = true;
+  unsigned int sent = sim.commands;
+  BC127::opResult result = BC127::SUCCESS;
+  check("first stdCmd() after the hang (ms)",
+        TIMED(result = bt.stdCmd("STATUS")), 0, 110);
+  check("  result", result, BC127::TIMEOUT_ERROR, BC127::TIMEOUT_ERROR);
+  check("  offline", bt.offline(), 1, 1);
+  check("connect() after that (ms)",
+        TIMED(result = bt.connect("20FABB010272", BC127::SPP)), 0, 0);
+  check("  result", result, BC127::TIMEOUT_ERROR, BC127::TIMEOUT_ERROR);
+  // Just the empty line that went unanswered.
+  check("lines the module was sent", sim.commands - sent, 1, 1);
+
+  // The module comes back; the next probe finds it.
+  sim.hung = false;
+  run(health, 500);
+  check("state after recovery", health.state(), BC127Health::HEALTHY,
+        BC127Health::HEALTHY);
+  check("outages", health.outages(), 1, 1);
+  check("stdCmd() after recovery", bt.stdCmd("STATUS"), BC127::SUCCESS,
+        BC127::SUCCESS);
+}
+
+// With nobody watching, the module is never marked offline, since nothing
+//  would bring it back; each call still gives up as soon as the empty line
+//  goes unanswered.
+static void hangUnwatched()
+{
+  printf("Hang found by a blocking call, no monitor:\n");
+  SimModule sim;
+  BC127 bt(&sim);
+
+  sim.hung = true;
+  BC127::opResult result = BC127::SUCCESS;
+  check("stdCmd() (ms)", TIMED(result = bt.stdCmd("STATUS")), 0, 110);
+  check("  result", result, BC127::TIMEOUT_ERROR, BC127::TIMEOUT_ERROR);
+  check("connect() (ms)",
+        TIMED(result = bt.connect("20FABB010272", BC127::SPP)), 0, 110);
+  check("  offline", bt.offline(), 0, 0);
+  check("  unanswered", bt.unanswered(), 1, 1);
+
+  sim.hung = false;
+  check("stdCmd() once it's back", bt.stdCmd("STATUS"), BC127::SUCCESS,
+        BC127::SUCCESS);
+  check("  unanswered", bt.unanswered(), 0, 0);
+}
+
+#if BC127_ENABLE_DATA_MODE
+// Answers STATUS according to whether the link is up.
+class DataModule : public SimModule
+{
+  public:
+    DataModule() : linked(true) {}
+
+    boolean linked;
+
+    // The other end goes away. The module drops back into command mode, and
+    //  says so.
+    void dropLink()
+    {
+      linked = false;
+      queueReply("CLOSE_OK 10 SPP 20FABB010272\n\r", 5);
+    }
+
+  protected:
+    virtual boolean reply(const char *command)
+    {
+      if (!startsWith(command, "STATUS")) return false;
+      if (linked)
+        queueReply("STATE CONNECTED\n\rLINK 10 CONNECTED SPP 20FABB010272\n\r"
+                   "OK\n\r", 20);
+      else queueReply("STATE CONNECTABLE\n\rOK\n\r", 20);
+      return true;
+    }
+};
+
+// No probes while the module's in data mode: they'd go over the air. When the
+//  link drops, the module's back in command mode, and the monitor has to
+//  notice that, or a hang after it would go unseen.
+static void dataModeLinkLoss()
+{
+  printf("Data mode, then the link drops:\n");
+  DataModule sim;
+  BC127 bt(&sim);
+  BC127Health health(&bt);
+  health.setProbe(200, 50);
+
+  bt.enterDataMode();
+  unsigned int probes = health.probes();
+  run(health, 2000);
+  check("probes sent in data mode", health.probes() - probes, 0, 0);
+
+  // The sketch finds its data has stopped flowing, and checks the link.
+  sim.dropLink();
+  run(health, 50);
+  check("connectionState()", bt.connectionState(), BC127::CONNECT_ERROR,
+        BC127::CONNECT_ERROR);
+  check("  dataMode", bt.dataMode(), 0, 0);
+
+  probes = health.probes();
+  run(health, 1000);
+  check("probes in the next second", health.probes() - probes, 3, 6);
+
+  sim.hung = true;
+  run(health, 1000);
+  check("state after a hang", health.state(), BC127Health::DOWN,
+        BC127Health::DOWN);
+  check("  detection time (ms)", health.lastDetectionTime(), 200, 260);
+}
+#endif
+
+int main()
+{
+  busyModule();
+  hangWhileIdle();
+  hangDuringCalls();
+  hangUnwatched();
+#if BC127_ENABLE_DATA_MODE
+  dataModeLinkLoss();
+#endif
+  printf(failures ? "FAILED: %d\n" : "All clear.\n", failures);
+  return failures ? 1 : 0;
+}
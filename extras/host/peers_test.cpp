@@ -0,0 +1,276 @@
+/****************************************************************
+Checks BC127PeerCache against a simulated module and a file store:
+that the list survives a reload, stays in most-recently-used order,
+and that a device which has gone away is skipped for one that's
+still there, or for one found by searching.
+
+This code is beerware; if you use it, please buy me (or any other
+SparkFun employee) a cold beverage next time you run into one of
+us at the local.
+****************************************************************/
+
+#include <stdio.h>
+#include <Arduino.h>
+#include "sim_module.h"
+#include "SparkFunbc127.h"
+#include "SparkFunbc127peers.h"
+#include "SparkFunbc127filestore.h"
+
+static int failures = 0;
+
+// Print a measurement, and fail unless it's between low and high.
+static void check(const char *name, long value, long low, long high)
+{
+  boolean ok = (value >= low && value <= high);
+  if (!ok) failures++;
+  printf("  %-44s %6ld%s\n", name, value, ok ? "" : "  <-- FAIL");
+}
+
+// Fail unless the cache holds address at index.
+static void checkPeer(BC127PeerCache &cache, byte index, const char *address)
+{
+  char name[48];
+  char found[BC127::ADDR_LEN];
+  cache.getPeer(index, found);
+  snprintf(name, sizeof(name), "peer %d is %s", index, address);
+  check(name, strcmp(found, address) == 0, 1, 1);
+}
+
+static const char *STORE_PATH = "peers_test.bin";
+
+static const char *LIVE = "20FABB010272";
+static const char *DEAD = "20FABB0102AA";
+static const char *CLASSIC = "20FABB0102BB";
+static const char *SINGLE_MODE = "20FABB0102CC";
+
+// Everything but DEAD answers an OPEN. An inquiry finds CLASSIC; a BLE scan
+//  finds SINGLE_MODE, which being BLE only, an inquiry never would.
+class PeerModule : public SimModule
+{
+  public:
+    PeerModule() : opens(0), searches(0) {}
+
+    unsigned int opens;
+    unsigned int searches;
+
+  protected:
+    virtual boolean reply(const char *command)
+    {
+      char line[64];
+      if (startsWith(command, "OPEN"))
+      {
+        opens++;
+        const char *address = command + 5;
+        if (!startsWith(address, DEAD))
+        {
+          snprintf(line, sizeof(line), "OPEN_OK 10 %s %.12s\n\r",
+                   command + 18, address);
+          queueReply(line, 60);
+        }
+        else queueReply("OPEN_ERROR\n\r", 500);
+      }
+      else if (startsWith(command, "INQUIRY"))
+      {
+        searches++;
+        snprintf(line, sizeof(line), "INQUIRY %s 240404 -60dBm\n\r",
+                 CLASSIC);
+        queueReply(line, 500);
+        queueReply("OK\n\r", 500);
+      }
+      else if (startsWith(command, "SCAN"))
+      {
+        searches++;
+        snprintf(line, sizeof(line), "SCAN %s <peer> 02 -60dBm\n\r",
+                 SINGLE_MODE);
+        queueReply(line, 500);
+        queueReply("OK\n\r", 500);
+      }
+      else return false;
+      return true;
+    }
+};
+
+// What's remembered comes back after a "power cycle", in the same order, and
+//  a store that's missing or damaged loads as an empty list.
+static void saveAndReload()
+{
+  printf("Save and reload:\n");
+  remove(STORE_PATH);
+  PeerModule sim;
+  BC127 bt(&sim);
+  BC127FileStore store(STORE_PATH);
+
+  BC127PeerCache cache(&bt, &store);
+  check("begin() with no file", cache.begin(), 0, 0);
+  cache.remember(DEAD, 1 << BC127::SPP);
+  cache.remember(LIVE, (1 << BC127::SPP) | (1 << BC127::A2DP));
+
+  BC127PeerCache reloaded(&bt, &store);
+  check("begin() after saving", reloaded.begin(), 1, 1);
+  check("  count", reloaded.count(), 2, 2);
+  checkPeer(reloaded, 0, LIVE);
+  checkPeer(reloaded, 1, DEAD);
+  char address[BC127::ADDR_LEN];
+  byte profiles = 0;
+  byte used = (1 << BC127::SPP) | (1 << BC127::A2DP);
+  reloaded.getPeer(0, address, &profiles);
+  check("  profiles of peer 0", profiles, used, used);
+
+  // Flip one byte of the file, as a half-finished write might.
+  FILE *file = fopen(STORE_PATH, "r+b");
+  fseek(file, 3, SEEK_SET);
+  int c = fgetc(file);
+  fseek(file, 3, SEEK_SET);
+  fputc(c ^ 0x01, file);
+  fclose(file);
+  BC127PeerCache damaged(&bt, &store);
+  check("begin() with a damaged file", damaged.begin(), 0, 0);
+  check("  count", damaged.count(), 0, 0);
+  remove(STORE_PATH);
+}
+
+// Using a device again moves it to the front; once the list is full, the one
+//  used longest ago falls off the end.
+static void mostRecentFirst()
+{
+  printf("Most recently used first:\n");
+  remove(STORE_PATH);
+  PeerModule sim;
+  BC127 bt(&sim);
+  BC127FileStore store(STORE_PATH);
+  BC127PeerCache cache(&bt, &store);
+  cache.begin();
+
+  char address[BC127::ADDR_LEN];
+  for (byte i = 0; i < BC127_PEER_CACHE_SIZE; i++)
+  {
+    snprintf(address, sizeof(address), "20FABB0100%02X", i);
+    cache.remember(address, 1 << BC127::SPP);
+  }
+  cache.remember("20FABB010000", 1 << BC127::SPP);
+  checkPeer(cache, 0, "20FABB010000");
+  check("count after using one again", cache.count(), BC127_PEER_CACHE_SIZE,
+        BC127_PEER_CACHE_SIZE);
+
+  cache.remember(LIVE, 1 << BC127::SPP);
+  check("count after one more", cache.count(), BC127_PEER_CACHE_SIZE,
+        BC127_PEER_CACHE_SIZE);
+  checkPeer(cache, 0, LIVE);
+  checkPeer(cache, 1, "20FABB010000");
+  // 01 is now the one used longest ago, so it's gone.
+  boolean dropped = true;
+  for (byte i = 0; i < cache.count(); i++)
+  {
+    cache.getPeer(i, address);
+    if (strcmp(address, "20FABB010001") == 0) dropped = false;
+  }
+  check("20FABB010001 dropped", dropped, 1, 1);
+
+  cache.forget(LIVE);
+  checkPeer(cache, 0, "20FABB010000");
+  check("remember() with a bad address", cache.remember("20FABB", 1),
+        BC127::INVALID_PARAM, BC127::INVALID_PARAM);
+  remove(STORE_PATH);
+}
+
+// The device used most recently has gone away; the one before it is still
+//  there. connectKnown() gets past the first to the second, and moves it to
+//  the front for next time.
+static void skipDeadPeer()
+{
+  printf("Skipping a device that's gone:\n");
+  remove(STORE_PATH);
+  PeerModule sim;
+  BC127 bt(&sim);
+  BC127FileStore store(STORE_PATH);
+  BC127PeerCache cache(&bt, &store);
+  cache.begin();
+  cache.remember(LIVE, 1 << BC127::SPP);
+  cache.remember(DEAD, 1 << BC127::SPP);
+
+  check("connectKnown()", cache.connectKnown(), BC127::SUCCESS,
+        BC127::SUCCESS);
+  check("  OPENs sent", sim.opens, 2, 2);
+  check("  searches", sim.searches, 0, 0);
+  checkPeer(cache, 0, LIVE);
+  check("  connected to", strcmp(bt.lastPeer(), LIVE) == 0, 1, 1);
+
+  // Nobody we know is there at all.
+  cache.forget(LIVE);
+  check("connectKnown() with only the dead one", cache.connectKnown(),
+        BC127::CONNECT_ERROR, BC127::CONNECT_ERROR);
+  remove(STORE_PATH);
+}
+
+#if BC127_ENABLE_ADDRESS_TABLE
+// When nobody we know answers, connectOrDiscover() searches, the right way
+//  for the profile asked for, connects to what it finds, and remembers it.
+static void discover(BC127::connType connection, const char *found,
+                     const char *title)
+{
+  printf("%s:\n", title);
+  remove(STORE_PATH);
+  PeerModule sim;
+  BC127 bt(&sim);
+  BC127FileStore store(STORE_PATH);
+  BC127PeerCache cache(&bt, &store);
+  cache.begin();
+  cache.remember(DEAD, 1 << BC127::SPP);
+
+  check("connectOrDiscover()", cache.connectOrDiscover(2, connection),
+        BC127::SUCCESS, BC127::SUCCESS);
+  check("  searches", sim.searches, 1, 1);
+  checkPeer(cache, 0, found);
+  byte profiles = 0;
+  char address[BC127::ADDR_LEN];
+  cache.getPeer(0, address, &profiles);
+  check("  remembered profile", profiles, 1 << connection, 1 << connection);
+
+  // Now it's known, there's no need to search for it again.
+  check("connectOrDiscover() again", cache.connectOrDiscover(2, connection),
+        BC127::SUCCESS, BC127::SUCCESS);
+  check("  searches", sim.searches, 1, 1);
+  remove(STORE_PATH);
+}
+#endif
+
+// Searching a way that's been compiled out is refused before anything is
+//  sent.
+static void compiledOut()
+{
+#if BC127_ENABLE_ADDRESS_TABLE && \
+    (!BC127_ENABLE_BLE || !BC127_ENABLE_CLASSIC_DISCOVERY)
+  printf("Search compiled out:\n");
+  remove(STORE_PATH);
+  PeerModule sim;
+  BC127 bt(&sim);
+  BC127FileStore store(STORE_PATH);
+  BC127PeerCache cache(&bt, &store);
+  cache.begin();
+#if !BC127_ENABLE_BLE
+  BC127::connType connection = BC127::BLE;
+#else
+  BC127::connType connection = BC127::SPP;
+#endif
+  check("connectOrDiscover()", cache.connectOrDiscover(2, connection),
+        BC127::INVALID_PARAM, BC127::INVALID_PARAM);
+  check("  lines the module was sent", sim.commands, 0, 0);
+  remove(STORE_PATH);
+#endif
+}
+
+int main()
+{
+  saveAndReload();
+  mostRecentFirst();
+  skipDeadPeer();
+#if BC127_ENABLE_CLASSIC_DISCOVERY
+  discover(BC127::SPP, CLASSIC, "Discovery by inquiry");
+#endif
+#if BC127_ENABLE_BLE
+  discover(BC127::BLE, SINGLE_MODE, "Discovery by BLE scan");
+#endif
+  compiledOut();
+  printf(failures ? "FAILED: %d\n" : "All clear.\n", failures);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,141 @@
+/****************************************************************
+Checks that an interactive command in a BC127Group never waits for
+more than the one command already running, however much background
+polling the sketch does.
+
+This code is beerware; if you use it, please buy me (or any other
+SparkFun employee) a cold beverage next time you run into one of
+us at the local.
+****************************************************************/
+
+#include <stdio.h>
+#include <Arduino.h>
+#include "sim_module.h"
+#include "SparkFunbc127.h"
+#include "SparkFunbc127group.h"
+
+static const unsigned long STATUS_TIME = 150;
+static const unsigned long GET_TIME = 80;
+static const unsigned long MUSIC_TIME = 30;
+static const unsigned long PRESS_EVERY = 437;
+static const unsigned long RUN_TIME = 60000;
+
+// STATUS is slow, GET less so, and the button press is quick. The module
+//  also notes when each press reaches it, which is the delay the user sees
+//  whatever class the command was queued in.
+class PriorityModule : public SimModule
+{
+  public:
+    PriorityModule() : pressed(0), arrived(0), totalDelay(0), maxDelay(0) {}
+
+    unsigned long pressTimes[8];
+    unsigned int pressed;
+    unsigned int arrived;
+    unsigned long totalDelay;
+    unsigned long maxDelay;
+
+    void press()
+    {
+      pressTimes[pressed++ % 8] = hostNow();
+    }
+
+  protected:
+    virtual boolean reply(const char *command)
+    {
+      if (startsWith(command, "STATUS"))
+        queueReply("STATE CONNECTED\n\rLINK 10 CONNECTED A2DP 20FABB010272\n\r"
+                   "OK\n\r", STATUS_TIME);
+      else if (startsWith(command, "GET NAME"))
+        queueReply("NAME=Hello\n\rOK\n\r", GET_TIME);
+      else if (startsWith(command, "MUSIC"))
+      {
+        unsigned long delay = hostNow() - pressTimes[arrived++ % 8];
+        totalDelay += delay;
+        if (delay > maxDelay) maxDelay = delay;
+        queueReply("OK\n\r", MUSIC_TIME);
+      }
+      else return false;
+      return true;
+    }
+};
+
+// One minute of a loop() that asks for STATUS and NAME on every pass, with a
+//  PAUSE press every 437 ms. With prioritize false, everything goes into the
+//  queue as an interactive stdCmd(), in the order it was asked for, and the
+//  polls only hold back enough to leave room for the press.
+static void run(boolean prioritize, PriorityModule &sim, BC127 &bt,
+                BC127Group &group)
+{
+  char name[BC127::LINE_BUF_LEN];
+  group.add(&bt);
+
+  hostResetClock();
+  unsigned long nextPress = PRESS_EVERY;
+  while (millis() < RUN_TIME)
+  {
+    if (prioritize)
+    {
+      group.connectionState(0);
+      group.stdGetParam(0, "NAME", name, sizeof(name));
+    }
+    else
+    {
+      if (group.pending(0) < BC127_GROUP_QUEUE_LEN - 1)
+        group.stdCmd(0, "STATUS");
+      if (group.pending(0) < BC127_GROUP_QUEUE_LEN - 1)
+        group.stdCmd(0, "GET NAME");
+    }
+    if (hostNow() >= nextPress)
+    {
+      sim.press();
+      group.stdCmd(0, "MUSIC 10 PAUSE");
+      nextPress += PRESS_EVERY;
+    }
+    group.poll();
+  }
+  while (!group.idle()) group.poll();
+}
+
+static void report(const char *name, PriorityModule &sim)
+{
+  printf("%-22s %3u presses, delay avg %3lu ms, worst %3lu ms\n", name,
+         sim.arrived, sim.arrived ? sim.totalDelay / sim.arrived : 0,
+         sim.maxDelay);
+}
+
+int main()
+{
+  PriorityModule fifoSim;
+  BC127 fifoBt(&fifoSim);
+  BC127Group fifo;
+  run(false, fifoSim, fifoBt, fifo);
+  report("one FIFO:", fifoSim);
+
+  PriorityModule prioritySim;
+  BC127 priorityBt(&prioritySim);
+  BC127Group priority;
+  run(true, prioritySim, priorityBt, priority);
+  report("priority classes:", prioritySim);
+  printf("  queue delay: interactive avg %lu ms, worst %lu ms; "
+         "background avg %lu ms, worst %lu ms; %u merged\n",
+         priority.averageQueueDelay(BC127Group::INTERACTIVE),
+         priority.maxQueueDelay(BC127Group::INTERACTIVE),
+         priority.averageQueueDelay(BC127Group::BACKGROUND),
+         priority.maxQueueDelay(BC127Group::BACKGROUND), priority.merged());
+
+  // A press can land just after a STATUS has gone out, so it may wait for
+  //  all of that one; a few milliseconds more covers the polling itself.
+  boolean ok = prioritySim.arrived == prioritySim.pressed &&
+               prioritySim.maxDelay <= STATUS_TIME + 10 &&
+               priority.failed() == 0;
+
+  // Not about priorities, but this is the group's test: once the group is
+  //  full, add() has to say so, even where char is unsigned.
+  BC127Group full;
+  for (byte i = 0; i < BC127_GROUP_SIZE; i++) full.add(&fifoBt);
+  int extra = full.add(&fifoBt);
+  printf("add() to a full group: %d\n", extra);
+  if (extra >= 0) ok = false;
+  printf(ok ? "All clear.\n" : "FAILED\n");
+  return ok ? 0 : 1;
+}
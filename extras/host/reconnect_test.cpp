@@ -0,0 +1,210 @@
+/****************************************************************
+Checks BC127Reconnect against a simulated module whose peer goes
+out of range: that it keeps trying until the peer answers, that it
+resets and then reconfigures the module when OPEN keeps failing,
+and that a profile it can't even start counts as a failed attempt.
+
+This code is beerware; if you use it, please buy me (or any other
+SparkFun employee) a cold beverage next time you run into one of
+us at the local.
+****************************************************************/
+
+#include <stdio.h>
+#include <Arduino.h>
+#include "sim_module.h"
+#include "SparkFunbc127.h"
+#include "SparkFunbc127reconnect.h"
+
+static int failures = 0;
+
+// Print a measurement, and fail unless it's between low and high.
+static void check(const char *name, long value, long low, long high)
+{
+  boolean ok = (value >= low && value <= high);
+  if (!ok) failures++;
+  printf("  %-44s %6ld%s\n", name, value, ok ? "" : "  <-- FAIL");
+}
+
+static const char *PEER = "20FABB010272";
+
+// The peer refuses as many OPENs as refusals says (it's out of range), then
+//  answers. Every OPEN, RESET and reconfigure goes in the log, one letter
+//  each: o for an OPEN that failed, O for one that worked, R and C.
+class RangeModule : public SimModule
+{
+  public:
+    RangeModule() : refusals(0)
+    {
+      clearLog();
+    }
+
+    unsigned int refusals;
+    char log[32];
+
+    void clearLog()
+    {
+      logLen = 0;
+      log[0] = '\0';
+    }
+    void note(char c)
+    {
+      if (logLen < sizeof(log) - 1) log[logLen++] = c;
+      log[logLen] = '\0';
+    }
+
+  protected:
+    virtual boolean reply(const char *command)
+    {
+      if (startsWith(command, "OPEN"))
+      {
+        char line[48];
+        if (refusals > 0)
+        {
+          refusals--;
+          note('o');
+          queueReply("OPEN_ERROR\n\r", 500);
+        }
+        else
+        {
+          note('O');
+          snprintf(line, sizeof(line), "OPEN_OK 10 %s %.12s\n\r",
+                   command + 18, command + 5);
+          queueReply(line, 60);
+        }
+      }
+      else if (startsWith(command, "RESET"))
+      {
+        note('R');
+        queueReply("Melody Audio V5.0 RC9\n\rReady\n\r", 300);
+      }
+      else return false;
+      return true;
+    }
+
+  private:
+    unsigned int logLen;
+};
+
+// Run the manager until it's connected again, or time runs out.
+static void run(BC127Reconnect &reconnect, unsigned long time)
+{
+  for (unsigned long end = millis() + time; millis() < end; )
+  {
+    if (reconnect.update() == BC127Reconnect::CONNECTED) return;
+  }
+}
+
+// The peer drops out for two attempts. Those are retried with a plain OPEN,
+//  and nothing more drastic.
+static void openErrorRecovery()
+{
+  printf("OPEN_ERROR twice, then the peer answers:\n");
+  RangeModule sim;
+  BC127 bt(&sim);
+  bt.connect(PEER, BC127::SPP);
+  sim.clearLog();
+  BC127Reconnect reconnect(&bt);
+  reconnect.setBackoff(100, 400);
+
+  sim.refusals = 2;
+  unsigned long lost = millis();
+  reconnect.linkLost();
+  run(reconnect, 10000);
+  check("state", reconnect.state(), BC127Reconnect::CONNECTED,
+        BC127Reconnect::CONNECTED);
+  check("recoveries", reconnect.recoveries(), 1, 1);
+  check("attempts", reconnect.attempts(), 3, 3);
+  check("resets", reconnect.resets(), 0, 0);
+  // Two OPEN_ERRORs at 500 ms, then backoff of 50-100 and 100-200 ms.
+  check("recovery time (ms)", reconnect.lastRecoveryTime(), 1150, 1500);
+  check("  as seen by the sketch (ms)", millis() - lost,
+        reconnect.lastRecoveryTime(), reconnect.lastRecoveryTime() + 1);
+  check("log is \"ooO\"", strcmp(sim.log, "ooO") == 0, 1, 1);
+}
+
+static RangeModule *reconfigured;
+
+static void reconfigure(BC127 *module)
+{
+  (void)module;
+  reconfigured->note('C');
+}
+
+// The peer stays away for four attempts. After two failed OPENs the module
+//  is reset; after two more, with one reset already tried, it's reconfigured.
+static void escalation()
+{
+  printf("Escalating to reset, then reconfigure:\n");
+  RangeModule sim;
+  BC127 bt(&sim);
+  bt.connect(PEER, BC127::SPP);
+  sim.clearLog();
+  BC127Reconnect reconnect(&bt);
+  reconnect.setBackoff(100, 400);
+  reconnect.setEscalation(2, 1);
+  reconfigured = &sim;
+  reconnect.setReconfigure(reconfigure);
+
+  sim.refusals = 4;
+  reconnect.linkLost();
+  run(reconnect, 20000);
+  check("state", reconnect.state(), BC127Reconnect::CONNECTED,
+        BC127Reconnect::CONNECTED);
+  check("recoveries", reconnect.recoveries(), 1, 1);
+  check("attempts", reconnect.attempts(), 5, 5);
+  check("resets", reconnect.resets(), 1, 1);
+  check("reconfigures", reconnect.reconfigures(), 1, 1);
+  // An OPEN after the reset as part of the same attempt, and another after
+  //  the reconfigure.
+  check("log is \"ooRooCO\"", strcmp(sim.log, "ooRooCO") == 0, 1, 1);
+}
+
+#if BC127_ENABLE_AUDIO
+// A2DP opens, but the module is marked offline before AVRCP can be started.
+//  That attempt has failed; it mustn't be counted as a recovery with AVRCP
+//  still closed.
+static void profileWontStart()
+{
+  printf("Offline between two profiles:\n");
+  RangeModule sim;
+  BC127 bt(&sim);
+  bt.connect(PEER, BC127::A2DP);
+  bt.connect(PEER, BC127::AVRCP);
+  sim.clearLog();
+  BC127Reconnect reconnect(&bt);
+  reconnect.setBackoff(100, 400);
+
+  reconnect.linkLost();
+  reconnect.update();
+  check("state after the first update()", reconnect.state(),
+        BC127Reconnect::OPENING, BC127Reconnect::OPENING);
+  // The A2DP OPEN is on its way; the module goes offline behind it.
+  bt.setOffline(true);
+  while (reconnect.update() == BC127Reconnect::OPENING) {}
+  check("state once A2DP is open", reconnect.state(), BC127Reconnect::WAITING,
+        BC127Reconnect::WAITING);
+  check("  recoveries", reconnect.recoveries(), 0, 0);
+  check("  log is \"O\" (no AVRCP)", strcmp(sim.log, "O") == 0, 1, 1);
+
+  bt.setOffline(false);
+  run(reconnect, 5000);
+  check("state once it's back", reconnect.state(), BC127Reconnect::CONNECTED,
+        BC127Reconnect::CONNECTED);
+  check("  recoveries", reconnect.recoveries(), 1, 1);
+  check("  attempts", reconnect.attempts(), 2, 2);
+  check("  log is \"OOO\"", strcmp(sim.log, "OOO") == 0, 1, 1);
+  check("  last OPEN was AVRCP", strstr(sim.lastCommand, " AVRCP") != NULL,
+        1, 1);
+}
+#endif
+
+int main()
+{
+  openErrorRecovery();
+  escalation();
+#if BC127_ENABLE_AUDIO
+  profileWontStart();
+#endif
+  printf(failures ? "FAILED: %d\n" : "All clear.\n", failures);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,229 @@
+/****************************************************************
+Checks what BC127Remote sends for a burst of presses, and that the
+volume and play state the module reports in events are picked up,
+wherever in the conversation those events turn up.
+
+This code is beerware; if you use it, please buy me (or any other
+SparkFun employee) a cold beverage next time you run into one of
+us at the local.
+****************************************************************/
+
+#include <stdio.h>
+#include <Arduino.h>
+#include "sim_module.h"
+#include "SparkFunbc127.h"
+#include "SparkFunbc127remote.h"
+
+static int failures = 0;
+
+#if BC127_ENABLE_AUDIO
+// Print a measurement, and fail unless it's between low and high.
+static void check(const char *name, long value, long low, long high)
+{
+  boolean ok = (value >= low && value <= high);
+  if (!ok) failures++;
+  printf("  %-44s %6ld%s\n", name, value, ok ? "" : "  <-- FAIL");
+}
+
+// Counts the music commands it gets. Set beforeError, and the next empty line
+//  gets that event ahead of its ERROR, as a real module will if the event
+//  happens at just the wrong moment.
+class MusicModule : public SimModule
+{
+  public:
+    MusicModule() : beforeError(NULL)
+    {
+      clear();
+    }
+
+    const char *beforeError;
+    unsigned int volumeSets;
+    int lastVolume;
+    unsigned int ups, downs, forwards, backs, plays, pauses, stops;
+
+    void clear()
+    {
+      volumeSets = 0;
+      lastVolume = -1;
+      ups = downs = forwards = backs = plays = pauses = stops = 0;
+    }
+
+  protected:
+    virtual boolean reply(const char *command)
+    {
+      if (command[0] == '\0' && beforeError != NULL)
+      {
+        queueReply(beforeError, 1);
+        queueReply("ERROR\n\r", 1);
+        beforeError = NULL;
+        return true;
+      }
+      if (startsWith(command, "VOLUME UP")) ups++;
+      else if (startsWith(command, "VOLUME DOWN")) downs++;
+      else if (startsWith(command, "VOLUME "))
+      {
+        volumeSets++;
+        lastVolume = atoi(command + 7);
+      }
+      else if (startsWith(command, "MUSIC FORWARD")) forwards++;
+      else if (startsWith(command, "MUSIC BACKWARD")) backs++;
+      else if (startsWith(command, "MUSIC PLAY")) plays++;
+      else if (startsWith(command, "MUSIC PAUSE")) pauses++;
+      else if (startsWith(command, "MUSIC STOP")) stops++;
+      return false;
+    }
+};
+
+static void run(BC127Remote &remote, unsigned long time)
+{
+  for (unsigned long end = millis() + time; millis() < end; ) remote.update();
+}
+
+// Press each of the given buttons 10 ms apart, then wait for it all to go out.
+static void pressAll(BC127Remote &remote, const BC127::audioCmds *buttons,
+                     byte count)
+{
+  for (byte i = 0; i < count; i++)
+  {
+    remote.press(buttons[i]);
+    run(remote, 10);
+  }
+  for (unsigned long end = millis() + 2000; millis() < end && !remote.idle(); )
+    remote.update();
+}
+
+// Six UPs and two DOWNs, from a known volume, are one VOLUME command; past
+//  the top, the level stops at VOLUME_MAX.
+static void volumeBurst()
+{
+  printf("A burst of volume presses:\n");
+  MusicModule sim;
+  BC127 bt(&sim);
+  BC127Remote remote(&bt);
+  bt.setVolume(5);
+  sim.clear();
+
+  const BC127::audioCmds burst[] = {BC127::UP, BC127::UP, BC127::UP,
+    BC127::DOWN, BC127::UP, BC127::UP, BC127::DOWN, BC127::UP};
+  pressAll(remote, burst, 8);
+  check("presses", remote.presses(), 8, 8);
+  check("commands sent", remote.commandsSent(), 1, 1);
+  check("  VOLUME <level>", sim.volumeSets, 1, 1);
+  check("  level", sim.lastVolume, 9, 9);
+  check("  VOLUME UP/DOWN", sim.ups + sim.downs, 0, 0);
+  check("volume()", bt.volume(), 9, 9);
+
+  const BC127::audioCmds up[] = {BC127::UP, BC127::UP, BC127::UP, BC127::UP,
+    BC127::UP, BC127::UP, BC127::UP, BC127::UP};
+  pressAll(remote, up, 8);
+  check("eight more UPs: level", sim.lastVolume, BC127::VOLUME_MAX,
+        BC127::VOLUME_MAX);
+  check("  commands sent", remote.commandsSent(), 2, 2);
+
+  // Already at the top, so there's nothing to send.
+  pressAll(remote, up, 1);
+  check("one more UP: commands sent", remote.commandsSent(), 2, 2);
+}
+
+// If we don't know the volume, there's no level to add the steps to, so
+//  they go out one at a time.
+static void volumeUnknown()
+{
+  printf("Volume presses, volume unknown:\n");
+  MusicModule sim;
+  BC127 bt(&sim);
+  BC127Remote remote(&bt);
+
+  const BC127::audioCmds burst[] = {BC127::UP, BC127::UP, BC127::UP};
+  pressAll(remote, burst, 3);
+  check("VOLUME UP", sim.ups, 3, 3);
+  check("VOLUME <level>", sim.volumeSets, 0, 0);
+  check("volume()", bt.volume(), -1, -1);
+}
+
+// FORWARDs and BACKs cancel out; PLAY, PAUSE and STOP go out at once, and
+//  when several pile up behind a running command, only the last one does.
+static void tracksAndTransport()
+{
+  printf("Track and transport presses:\n");
+  MusicModule sim;
+  BC127 bt(&sim);
+  BC127Remote remote(&bt);
+
+  const BC127::audioCmds tracks[] = {BC127::FORWARD, BC127::FORWARD,
+    BC127::BACK, BC127::FORWARD};
+  pressAll(remote, tracks, 4);
+  check("MUSIC FORWARD", sim.forwards, 2, 2);
+  check("MUSIC BACKWARD", sim.backs, 0, 0);
+
+  sim.clear();
+  unsigned int sent = remote.commandsSent();
+  remote.press(BC127::PLAY);
+  remote.update();
+  check("PLAY sent at once", sim.plays, 1, 1);
+  remote.press(BC127::PAUSE);
+  remote.press(BC127::STOP);
+  remote.press(BC127::PLAY);
+  remote.press(BC127::PAUSE);
+  pressAll(remote, NULL, 0);
+  check("commands sent for five presses", remote.commandsSent() - sent, 2, 2);
+  check("  MUSIC PLAY", sim.plays, 1, 1);
+  check("  MUSIC STOP", sim.stops, 0, 0);
+  check("  MUSIC PAUSE", sim.pauses, 1, 1);
+  check("playState()", bt.playState(), BC127::PAUSED, BC127::PAUSED);
+}
+
+// Events can arrive at any time: before a command, between the "\r" that
+//  clears the way and its ERROR, or while nothing's happening at all.
+static void events()
+{
+  printf("Events:\n");
+  MusicModule sim;
+  BC127 bt(&sim);
+  BC127Remote remote(&bt);
+
+  sim.queueReply("AVRCP_PLAY 10\n\r", 5);
+  run(remote, 10);
+  check("setVolume() with AVRCP_PLAY waiting", bt.setVolume(7),
+        BC127::SUCCESS, BC127::SUCCESS);
+  check("  volume()", bt.volume(), 7, 7);
+  check("  playState()", bt.playState(), BC127::PLAYING, BC127::PLAYING);
+
+  sim.beforeError = "AVRCP_PAUSE 10\n\r";
+  check("setVolume() with an event before ERROR", bt.setVolume(3),
+        BC127::SUCCESS, BC127::SUCCESS);
+  check("  volume()", bt.volume(), 3, 3);
+  check("  playState()", bt.playState(), BC127::PAUSED, BC127::PAUSED);
+
+  // Now the same for a non-blocking command; the remote has to get its own
+  //  result, not the event.
+  sim.clear();
+  sim.beforeError = "ABS_VOL 10 127\n\r";
+  remote.press(BC127::PLAY);
+  pressAll(remote, NULL, 0);
+  check("PLAY with an event before ERROR: sent", sim.plays, 1, 1);
+  check("  playState()", bt.playState(), BC127::PLAYING, BC127::PLAYING);
+  check("  volume()", bt.volume(), BC127::VOLUME_MAX, BC127::VOLUME_MAX);
+
+  // The phone turns the volume down while we're idle; the remote picks that
+  //  up, and counts its steps from there.
+  sim.queueReply("ABS_VOL 10 64\n\r", 5);
+  run(remote, 20);
+  check("volume() after ABS_VOL 64", bt.volume(), 8, 8);
+  const BC127::audioCmds up[] = {BC127::UP, BC127::UP};
+  pressAll(remote, up, 2);
+  check("two UPs: level", sim.lastVolume, 10, 10);
+}
+#endif
+
+int main()
+{
+#if BC127_ENABLE_AUDIO
+  volumeBurst();
+  volumeUnknown();
+  tracksAndTransport();
+  events();
+#endif
+  printf(failures ? "FAILED: %d\n" : "All clear.\n", failures);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,123 @@
+/****************************************************************
+Checks that the helper classes really can share one module: a
+BC127Group kept busy with background polls mustn't lock out a
+BC127Remote, a BC127Reconnect or a BC127Health on the same module.
+
+This code is beerware; if you use it, please buy me (or any other
+SparkFun employee) a cold beverage next time you run into one of
+us at the local.
+****************************************************************/
+
+#include <stdio.h>
+#include <Arduino.h>
+#include "sim_module.h"
+#include "SparkFunbc127.h"
+#include "SparkFunbc127group.h"
+#include "SparkFunbc127health.h"
+#include "SparkFunbc127reconnect.h"
+#include "SparkFunbc127remote.h"
+
+static int failures = 0;
+
+// Print a measurement, and fail unless it's between low and high.
+static void check(const char *name, long value, long low, long high)
+{
+  boolean ok = (value >= low && value <= high);
+  if (!ok) failures++;
+  printf("  %-44s %6ld%s\n", name, value, ok ? "" : "  <-- FAIL");
+}
+
+class SharedModule : public SimModule
+{
+  public:
+    SharedModule() : opens(0), music(0) {}
+
+    unsigned int opens;
+    unsigned int music;
+
+  protected:
+    virtual boolean reply(const char *command)
+    {
+      if (startsWith(command, "STATUS"))
+        queueReply("STATE CONNECTED\n\rLINK 10 CONNECTED SPP 20FABB010272\n\r"
+                   "OK\n\r", 40);
+      else if (startsWith(command, "OPEN"))
+      {
+        opens++;
+        queueReply("OPEN_OK 10 SPP 20FABB010272\n\r", 60);
+      }
+      else if (startsWith(command, "MUSIC"))
+      {
+        music++;
+        queueReply("OK\n\r", 20);
+      }
+      else return false;
+      return true;
+    }
+};
+
+// Five seconds of a loop() that keeps the group's queue topped up with
+//  connectionState() polls, so the group always has something to start.
+//  Meanwhile the link drops once, and a PAUSE button is pressed every 200ms.
+static void groupWithOthers()
+{
+  printf("Group kept busy, sharing with the others:\n");
+  SharedModule sim;
+  BC127 bt(&sim);
+  bt.connect("20FABB010272", BC127::SPP);
+
+  BC127Group group;
+  group.add(&bt);
+  BC127Health health(&bt);
+  BC127Reconnect reconnect(&bt);
+#if BC127_ENABLE_AUDIO
+  BC127Remote remote(&bt);
+#endif
+
+  unsigned long start = millis();
+#if BC127_ENABLE_AUDIO
+  unsigned long nextPress = start + 200;
+#endif
+  boolean dropped = false;
+  while (millis() - start < 5000)
+  {
+    group.connectionState(0);
+    if (!dropped && millis() - start >= 1000)
+    {
+      reconnect.linkLost();
+      dropped = true;
+    }
+#if BC127_ENABLE_AUDIO
+    if (millis() >= nextPress)
+    {
+      remote.press(BC127::PAUSE);
+      nextPress += 200;
+    }
+    remote.update();
+#endif
+    reconnect.update();
+    health.update();
+    group.poll();
+  }
+
+  check("group polls completed", group.completed(), 50, 200);
+  check("group polls failed", group.failed(), 0, 0);
+  check("reconnect recoveries", reconnect.recoveries(), 1, 1);
+  check("reconnect attempts", reconnect.attempts(), 1, 1);
+  check("OPENs the module got (one to start with)", sim.opens, 2, 2);
+#if BC127_ENABLE_AUDIO
+  check("remote presses", remote.presses(), 24, 25);
+  check("remote commands sent", remote.commandsSent(), remote.presses(),
+        remote.presses());
+  check("MUSIC commands the module got", sim.music, remote.presses(),
+        remote.presses());
+#endif
+  check("health outages", health.outages(), 0, 0);
+}
+
+int main()
+{
+  groupWithOthers();
+  printf(failures ? "FAILED: %d\n" : "All clear.\n", failures);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,122 @@
+/****************************************************************
+A simulated BC127 for the host tests: it takes commands over a fake
+serial port and answers them after a delay, on the simulated clock.
+
+This code is beerware; if you use it, please buy me (or any other
+SparkFun employee) a cold beverage next time you run into one of
+us at the local.
+****************************************************************/
+
+#ifndef HOST_SIM_MODULE_H
+#define HOST_SIM_MODULE_H
+
+#include <Arduino.h>
+
+// The module handles one command at a time, like the real thing: each reply
+//  is scheduled after the one before it, and its characters become readable
+//  once the simulated clock gets there. Everything lives in fixed buffers, so
+//  the module itself never touches the heap (the allocation test depends on
+//  that).
+//
+// By default, an empty line gets "ERROR" after 1 ms and anything else gets
+//  "OK" after replyTime ms. The "$$$$" that ends data mode doesn't need a
+//  "\r", and gets "OK" too. Override reply() to answer differently; call
+//  queueReply() from it as many times as you like, and return true. While
+//  hung is set, the module still counts what it's sent, but never answers.
+class SimModule : public Stream
+{
+  public:
+    SimModule() : replyTime(20), hung(false), commands(0), _cmdLen(0),
+                  _head(0), _tail(0), _busyUntil(0)
+    {
+      lastCommand[0] = '\0';
+    }
+
+    unsigned long replyTime;
+    boolean hung;
+    unsigned int commands;    // Commands received, including empty lines.
+    char lastCommand[64];
+
+    // Make text readable delay ms after the end of the last reply.
+    void queueReply(const char *text, unsigned long delay)
+    {
+      unsigned long now = hostNow();
+      if (_busyUntil < now) _busyUntil = now;
+      _busyUntil += delay;
+      while (*text != '\0' && (_tail + 1) % BUF_LEN != _head)
+      {
+        _buf[_tail].c = *text++;
+        _buf[_tail].at = _busyUntil;
+        _tail = (_tail + 1) % BUF_LEN;
+      }
+    }
+
+    virtual int available()
+    {
+      int n = 0;
+      unsigned long now = hostNow();
+      for (unsigned int i = _head; i != _tail && _buf[i].at <= now;
+           i = (i + 1) % BUF_LEN) n++;
+      return n;
+    }
+    virtual int read()
+    {
+      if (_head == _tail || _buf[_head].at > hostNow()) return -1;
+      char c = _buf[_head].c;
+      _head = (_head + 1) % BUF_LEN;
+      return c;
+    }
+    virtual int peek()
+    {
+      if (_head == _tail || _buf[_head].at > hostNow()) return -1;
+      return _buf[_head].c;
+    }
+    virtual size_t write(uint8_t c)
+    {
+      if (c != '\r')
+      {
+        if (_cmdLen < sizeof(lastCommand) - 1) _cmdLen++;
+        lastCommand[_cmdLen - 1] = c;
+        if (_cmdLen == 4 && strncmp(lastCommand, "$$$$", 4) == 0)
+        {
+          _cmdLen = 0;
+          if (!hung) queueReply("OK\n\r", replyTime);
+        }
+        return 1;
+      }
+      lastCommand[_cmdLen] = '\0';
+      _cmdLen = 0;
+      commands++;
+      if (hung) return 1;
+      if (!reply(lastCommand))
+      {
+        if (lastCommand[0] == '\0') queueReply("ERROR\n\r", 1);
+        else queueReply("OK\n\r", replyTime);
+      }
+      return 1;
+    }
+    using Print::write;
+
+  protected:
+    virtual boolean reply(const char *command) { (void)command; return false; }
+
+  private:
+    enum {BUF_LEN = 1024};
+    struct timedChar
+    {
+      char c;
+      unsigned long at;
+    };
+    timedChar _buf[BUF_LEN];
+    unsigned int _cmdLen;
+    unsigned int _head;
+    unsigned int _tail;
+    unsigned long _busyUntil;
+};
+
+static inline boolean startsWith(const char *text, const char *prefix)
+{
+  return strncmp(text, prefix, strlen(prefix)) == 0;
+}
+
+#endif
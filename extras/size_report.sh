@@ -0,0 +1,123 @@
+#!/bin/sh
+#
+# Flash and RAM used by the library with each feature switch turned off, on
+#  the boards you name (an Uno and an Uno R4 Minima if you don't):
+#
+#    extras/size_report.sh
+#    extras/size_report.sh arduino:avr:mega arduino:renesas_uno:minima
+#
+# Needs arduino-cli, with the cores for those boards installed
+#  (arduino-cli core install arduino:avr arduino:renesas_uno). Each
+#  configuration is built with arduino-cli, using the switches in
+#  src/SparkFunbc127config.h as -D flags, and then measured:
+#
+#    flash       text + data of the library's object files, which is what
+#                the library costs if you call every function it has
+#    static RAM  data + bss of the same files
+#    BC127       sizeof(BC127), which every module you declare costs on top
+#
+# This code is beerware; if you use it, please buy me (or any other
+# SparkFun employee) a cold beverage next time you run into one of
+# us at the local.
+
+set -e
+
+LIBRARY=$(cd "$(dirname "$0")/.." && pwd)
+if [ $# -eq 0 ]; then
+  set -- arduino:avr:uno arduino:renesas_uno:minima
+fi
+
+# The switches to try, one at a time, then all at once.
+CONFIGS="none
+BC127_ENABLE_CLASSIC_DISCOVERY
+BC127_ENABLE_BLE
+BC127_ENABLE_AUDIO
+BC127_ENABLE_DATA_MODE
+all"
+ALL_OFF="-DBC127_ENABLE_CLASSIC_DISCOVERY=0 -DBC127_ENABLE_BLE=0 \
+-DBC127_ENABLE_AUDIO=0 -DBC127_ENABLE_DATA_MODE=0"
+
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+# The sketch only has to pull the library in; arduino-cli then compiles all
+#  of it. The array is there so nm can tell us sizeof(BC127), and is written
+#  to so the linker doesn't throw it away.
+SKETCH="$WORK/size_report"
+mkdir "$SKETCH"
+cat > "$SKETCH/size_report.ino" <<'EOF'
+#include <SparkFunbc127.h>
+
+volatile char bc127Size[sizeof(BC127)];
+
+void setup()
+{
+  bc127Size[0] = 0;
+}
+
+void loop()
+{
+}
+EOF
+
+# Find one of the toolchain's programs (avr-size, arm-none-eabi-nm, ...): on
+#  the PATH if it's there, otherwise wherever arduino-cli installed it.
+findTool()
+{
+  if command -v "$1" > /dev/null 2>&1; then
+    command -v "$1"
+    return
+  fi
+  data=$(arduino-cli config get directories.data 2> /dev/null || true)
+  [ -n "$data" ] || data="$HOME/.arduino15"
+  found=$(find "$data/packages" -type f -name "$1" 2> /dev/null | head -n 1)
+  if [ -z "$found" ]; then
+    echo "size_report: can't find $1" >&2
+    exit 1
+  fi
+  echo "$found"
+}
+
+for board in "$@"; do
+  case "$board" in
+    *:avr:*) prefix=avr- ;;
+    *) prefix=arm-none-eabi- ;;
+  esac
+  size=$(findTool "${prefix}size")
+  nm=$(findTool "${prefix}nm")
+
+  echo
+  echo "$board"
+  printf '  %-32s %8s %12s %8s\n' "turned off" "flash" "static RAM" "BC127"
+
+  echo "$CONFIGS" | while read -r config; do
+    case "$config" in
+      none) flags="" ;;
+      all) flags="$ALL_OFF" ;;
+      *) flags="-D$config=0" ;;
+    esac
+    build="$WORK/build-$config"
+    if ! arduino-cli compile --fqbn "$board" --library "$LIBRARY" \
+         --build-path "$build" \
+         --build-property "compiler.cpp.extra_flags=$flags" \
+         "$SKETCH" > "$WORK/log" 2>&1; then
+      echo "  $config: build failed" >&2
+      cat "$WORK/log" >&2
+      exit 1
+    fi
+
+    # The library's objects end up under libraries/, one directory per
+    #  library; ours is the only library the sketch uses.
+    objects=$(find "$build/libraries" -name '*.o')
+    # shellcheck disable=SC2086
+    totals=$("$size" -t $objects | tail -n 1)
+    text=$(echo "$totals" | awk '{print $1}')
+    data=$(echo "$totals" | awk '{print $2}')
+    bss=$(echo "$totals" | awk '{print $3}')
+    bc127=$("$nm" -S "$build/size_report.ino.elf" | \
+            awk '$4 == "bc127Size" {print $2}')
+
+    printf '  %-32s %8d %12d %8d\n' "$config" $((text + data)) \
+           $((data + bss)) $((0x$bc127))
+  done
+done
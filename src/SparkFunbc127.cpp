@@ -13,19 +13,622 @@ Code developed in Arduino 1.0.5, on an Arduino Pro Mini 5V.
 #include "SparkFunbc127.h"
 #include <Arduino.h>
 
+// All the fixed strings we send to the module. On an AVR these would
+//  otherwise be copied into RAM at startup; PROGMEM keeps them in flash. The
+//  order here MUST match the cmdStrings enum in the header.
+static const char s_RESTORE[] PROGMEM = "RESTORE";
+static const char s_WRITE[] PROGMEM = "WRITE";
+static const char s_RESET[] PROGMEM = "RESET";
+static const char s_STATUS[] PROGMEM = "STATUS";
+static const char s_SET[] PROGMEM = "SET ";
+static const char s_GET[] PROGMEM = "GET ";
+static const char s_OPEN[] PROGMEM = "OPEN ";
+static const char s_BAUD[] PROGMEM = "BAUD";
+static const char s_LOCAL_ADDR[] PROGMEM = "LOCAL_ADDR";
+static const char s_ZERO[] PROGMEM = "0";
+static const char s_ONE[] PROGMEM = "1";
+static const char s_TWO[] PROGMEM = "2";
+#if BC127_ENABLE_DATA_MODE
+static const char s_ENTER_DATA[] PROGMEM = "ENTER_DATA";
+#endif
+#if BC127_ENABLE_CLASSIC_DISCOVERY
+static const char s_INQUIRY[] PROGMEM = "INQUIRY ";
+#endif
+#if BC127_ENABLE_BLE
+static const char s_ADV_ON[] PROGMEM = "ADVERTISING ON";
+static const char s_ADV_OFF[] PROGMEM = "ADVERTISING OFF";
+static const char s_SCAN[] PROGMEM = "SCAN ";
+static const char s_BLE_ROLE[] PROGMEM = "BLE_ROLE";
+#endif
+#if BC127_ENABLE_AUDIO
+static const char s_CLASSIC_ROLE[] PROGMEM = "CLASSIC_ROLE";
+static const char s_MUSIC_PLAY[] PROGMEM = "MUSIC PLAY";
+static const char s_MUSIC_PAUSE[] PROGMEM = "MUSIC PAUSE";
+static const char s_MUSIC_FORWARD[] PROGMEM = "MUSIC FORWARD";
+static const char s_MUSIC_BACK[] PROGMEM = "MUSIC BACKWARD";
+static const char s_VOLUME_UP[] PROGMEM = "VOLUME UP";
+static const char s_VOLUME_DOWN[] PROGMEM = "VOLUME DOWN";
+static const char s_MUSIC_STOP[] PROGMEM = "MUSIC STOP";
+static const char s_VOLUME[] PROGMEM = "VOLUME ";
+#endif
+static const char s_SPP[] PROGMEM = " SPP";
+static const char s_BLE[] PROGMEM = " BLE";
+static const char s_A2DP[] PROGMEM = " A2DP";
+static const char s_HFP[] PROGMEM = " HFP";
+static const char s_AVRCP[] PROGMEM = " AVRCP";
+static const char s_PBAP[] PROGMEM = " PBAP";
+static const char s_9600[] PROGMEM = "9600";
+static const char s_19200[] PROGMEM = "19200";
+static const char s_38400[] PROGMEM = "38400";
+static const char s_57600[] PROGMEM = "57600";
+static const char s_115200[] PROGMEM = "115200";
+
+static const char * const cmdTable[] PROGMEM = {
+  s_RESTORE, s_WRITE, s_RESET, s_STATUS, s_SET, s_GET, s_OPEN, s_BAUD,
+  s_LOCAL_ADDR, s_ZERO, s_ONE, s_TWO,
+#if BC127_ENABLE_DATA_MODE
+  s_ENTER_DATA,
+#endif
+#if BC127_ENABLE_CLASSIC_DISCOVERY
+  s_INQUIRY,
+#endif
+#if BC127_ENABLE_BLE
+  s_ADV_ON, s_ADV_OFF, s_SCAN, s_BLE_ROLE,
+#endif
+#if BC127_ENABLE_AUDIO
+  s_CLASSIC_ROLE,
+  s_MUSIC_PLAY, s_MUSIC_PAUSE, s_MUSIC_FORWARD, s_MUSIC_BACK, s_VOLUME_UP,
+  s_VOLUME_DOWN, s_MUSIC_STOP, s_VOLUME,
+#endif
+  s_SPP, s_BLE, s_A2DP, s_HFP, s_AVRCP, s_PBAP,
+  s_9600, s_19200, s_38400, s_57600, s_115200};
+
+const __FlashStringHelper *BC127::cmdString(cmdStrings index)
+{
+  return reinterpret_cast<const __FlashStringHelper *>(
+    pgm_read_ptr(&cmdTable[index]));
+}
+
 // Constructor. All we really need to do is link the user's Stream instance to
 //  our local reference.
 BC127::BC127(Stream *sp)
 {
   _serialPort = sp;
+#if BC127_ENABLE_ADDRESS_TABLE
   _numAddresses = -1;
+#endif
+  _cmdOverflow = false;
+  _asyncState = ASYNC_IDLE;
+  _asyncResult = SUCCESS;
+  _asyncTag = 0;
+  _lastPeer[0] = '\0';
+  _lastProfiles = 0;
+  _lastHeard = 0;
+  _unanswered = false;
+  _offline = false;
+  _silenceOffline = false;
+  _dataMode = false;
+  _firmware[0] = '\0';
+  _firmwareMajor = 0;
+  _firmwareMinor = 0;
+  _firmwareBuild = 0;
+  _resetStart = 0;
+  _bootTime = 0;
+  _firstCommand = 0;
+  _awaitingCommand = false;
+  _statusResult = TIMEOUT_ERROR;
+  _getName = NULL;
+  _getNameInFlash = false;
+  _getParam = NULL;
+  _getParamLen = 0;
+#if BC127_ENABLE_AUDIO
+  _volume = -1;
+  _playState = PLAY_UNKNOWN;
+  _asyncMusic = NO_MUSIC;
+  _asyncVolume = -1;
+#endif
+  lineClear();
+}
+
+// Default serial port handlers. These go through the Stream class, so each
+//  call is a virtual function call; see BC127Port in the header for the
+//  version that avoids that.
+void BC127::portWrite(const char *buffer, size_t length)
+{
+  _serialPort->write((const uint8_t*)buffer, length);
+  _serialPort->flush();
+}
+
+// Collect characters into _lineBuf until we see the EOL string or run out of
+//  time. If restartOnData is set, the timeout is measured from the last
+//  character received rather than from startTime.
+boolean BC127::portReadLine(unsigned long startTime, unsigned long timeout,
+                            boolean restartOnData)
+{
+  lineClear();
+  if (_offline) return false;
+  while (millis() - startTime < timeout)
+  {
+    if (_serialPort->available() > 0)
+    {
+      if (restartOnData) startTime = millis();
+      if (lineAppend((char)_serialPort->read())) return true;
+    }
+  }
+  return false;
+}
+
+void BC127::portPurge()
+{
+  while (_serialPort->available() > 0) _serialPort->read();
+}
+
+boolean BC127::portPollLine()
+{
+  while (_serialPort->available() > 0)
+  {
+    if (lineAppend((char)_serialPort->read())) return true;
+  }
+  return false;
+}
+
+// Commands are built up piece by piece in _lineBuf, then sent in a single
+//  write; printing the pieces one at a time costs a trip through Print for
+//  every byte. If a command won't fit, we remember that and refuse to send it
+//  rather than sending half a command.
+void BC127::cmdStart()
+{
+  lineClear();
+  _cmdOverflow = false;
+}
+
+void BC127::cmdAppend(const char *part)
+{
+  size_t partLen = strlen(part);
+  // Leave room for the "\r" on the end.
+  if (_lineLen + partLen + 1 >= LINE_BUF_LEN) _cmdOverflow = true;
+  else
+  {
+    memcpy(_lineBuf + _lineLen, part, partLen);
+    _lineLen += partLen;
+  }
+}
+
+void BC127::cmdAppend(const __FlashStringHelper *part)
+{
+  PGM_P p = reinterpret_cast<PGM_P>(part);
+  size_t partLen = strlen_P(p);
+  if (_lineLen + partLen + 1 >= LINE_BUF_LEN) _cmdOverflow = true;
+  else
+  {
+    memcpy_P(_lineBuf + _lineLen, p, partLen);
+    _lineLen += partLen;
+  }
+}
+
+boolean BC127::cmdWrite()
+{
+  // Nothing goes out to a module that's offline; a reply turning up late,
+  //  after it comes back, would be taken for the reply to something else.
+  if (_cmdOverflow || _offline) return false;
+  // The empty line knownStart() sends ahead of a command isn't the first
+  //  command; asyncSend() doesn't count its "\r" either.
+  boolean empty = (_lineLen == 0);
+  _lineBuf[_lineLen++] = '\r';
+  portWrite(_lineBuf, _lineLen);
+  if (_awaitingCommand && !empty)
+  {
+    _firstCommand = millis() - _resetStart;
+    _awaitingCommand = false;
+  }
+  return true;
+}
+
+// There are several commands that look for either OK or ERROR; this sends
+//  the command we've built and waits for one of those.
+BC127::opResult BC127::cmdSend(unsigned long timeout)
+{
+  if (!cmdWrite()) return _offline ? TIMEOUT_ERROR : INVALID_PARAM;
+  
+  // We're going to use the internal timer to track the elapsed time since we
+  //  issued the command. Bog-standard Arduino stuff.
+  unsigned long startTime = millis();
+  
+  while (portReadLine(startTime, timeout))
+  {
+    opResult result = parseReply(REPLY_OK);
+    if (result != IN_PROGRESS) return result;
+  }
+  return TIMEOUT_ERROR;
+}
+
+// All the replies we know how to wait for, in one place so the blocking and
+//  non-blocking versions of a command agree on what they mean.
+BC127::opResult BC127::parseReply(replyTypes type)
+{
+  noteLine();
+  switch(type)
+  {
+    case REPLY_OK:
+      if (lineStartsWith(F("ER"))) return MODULE_ERROR;
+      if (lineStartsWith(F("OK"))) return SUCCESS;
+      break;
+    // The OPEN command can answer with any of these:
+    //  "ERROR" - there's a syntax error in your message to the module; this is
+    //    kind of unlikely, although it could happen if you call this function
+    //    with an invalid address (something not entirely uppercase hex digits)
+    //  "OPEN_ERROR" - most likely, the module can't find any devices with that
+    //    address.
+    //  "PAIR_ERROR" - the connection was refused by the remote module.
+    //  "PAIR_OK" - the connection has been made, but the SPP channel is not
+    //    yet open. We should probably just ignore this.
+    //  "OPEN_OK" - ready to rock! This is when we should return success.
+    case REPLY_OPEN:
+      if (lineStartsWith(F("ERROR"))) return MODULE_ERROR;
+      if (lineStartsWith(F("OPEN_ERROR"))) return CONNECT_ERROR;
+      if (lineStartsWith(F("PAIR_ERROR"))) return REMOTE_ERROR;
+      if (lineStartsWith(F("OPEN_OK"))) return SUCCESS;
+      break;
+    // Any answer at all will do for a ping.
+    case REPLY_PING:
+      return SUCCESS;
+    // After a reset, the last line of the banner is "Ready", and the module
+    //  will take commands as soon as it's sent it. The lines before it have
+    //  already been through noteBanner().
+    case REPLY_RESET:
+      if (lineStartsWith(F("ER"))) return MODULE_ERROR;
+      if (lineStartsWith(F("Ready")))
+      {
+        _dataMode = false;
+        _bootTime = millis() - _resetStart;
+        _awaitingCommand = true;
+        return SUCCESS;
+      }
+      break;
+    // STATUS answers with a "STATE ..." line, then a "LINK ..." line for each
+    //  open connection, then "OK". We remember what the STATE line said and
+    //  report it when the OK arrives.
+    case REPLY_STATUS:
+      if (lineStartsWith(F("ER"))) return MODULE_ERROR;
+      if (lineStartsWith(F("OK"))) return _statusResult;
+      // If the current line starts with "STATE", we need more parsing. This is
+      //  also the only guaranteed result.
+      if (lineStartsWith(F("ST")))
+      {
+        // If "CONNECTED" is in the received string, we know we're connected,
+        //  but not if we're connected with the particular profile we're
+        //  interested in. So, we need to consider a bit further.
+        if (_lineLen >= 15 && strncmp(_lineBuf + 13, "ED", 2) == 0)
+          _statusResult = SUCCESS;
+        // If "CONNECTED" *isn't* there, we want to return an appropriate error.
+        else _statusResult = CONNECT_ERROR;
+      }
+      // If we ARE connected, we'll get a list of different link types. We
+      //  could parse over those and see if the profile we want is in it, but
+      //  we'll always overflow the soft serial buffer if we have more than one
+      //  type of connection open, so we don't try.
+      break;
+    // GET answers with "<name>=<value>", then "OK". The name may be in flash
+    //  or RAM, so we need to know which to compare against it correctly.
+    case REPLY_GET:
+      if (lineStartsWith(F("ER"))) return MODULE_ERROR;
+      if (lineStartsWith(F("OK"))) return SUCCESS;
+      {
+        size_t nameLen = _getNameInFlash ? strlen_P(_getName) :
+                                           strlen(_getName);
+        int match = _getNameInFlash ? strncmp_P(_lineBuf, _getName, nameLen) :
+                                      strncmp(_lineBuf, _getName, nameLen);
+        if (match == 0 && _lineLen > nameLen)
+        {
+          // Copy the value, minus the "=" and any whitespace or EOL around it.
+          const char *value = _lineBuf + nameLen + 1;
+          while (*value == ' ') value++;
+          size_t valueLen = strlen(value);
+          while (valueLen > 0 && (value[valueLen-1] == ' ' ||
+                 value[valueLen-1] == '\r' || value[valueLen-1] == '\n'))
+            valueLen--;
+          if (valueLen > _getParamLen - 1) valueLen = _getParamLen - 1;
+          memcpy(_getParam, value, valueLen);
+          _getParam[valueLen] = '\0';
+        }
+      }
+      break;
+#if BC127_ENABLE_CLASSIC_DISCOVERY
+    // Oooookaaaayyy...now the fun part. During an inquiry, there are three
+    //  potential results to expect:
+    // "OK" - The module has finished scanning (timed out) and the results we
+    //   have are the only ones we'll ever get.
+    // "ERROR" - Something went wrong and we're not scanning.
+    // "INQUIRY <addr> <class> <rss>" - A remote device has responded. <addr>
+    //   will be 12 upper case hex digits, and is the remote device's address,
+    //   to be used to refer to that device later on. <class> is the remote
+    //   device class; for example, by default, the BC127 will return 240404,
+    //   which corresponds to a Bluetooth headset. <rss> is the received signal
+    //   strength; generally, -70dBm is a good link strength.
+    // We may get duplicates; we only want to keep new addresses.
+    case REPLY_INQUIRY:
+      if (lineStartsWith(F("OK"))) return (opResult)_numAddresses;
+      if (lineStartsWith(F("ER"))) return MODULE_ERROR;
+      if (lineStartsWith(F("IN"))) return addressFound(8);
+      break;
+#endif
+#if BC127_ENABLE_BLE
+    // Scans are the same, but the lines look like this:
+    //  SCAN <addr> <short_name> <role> <RSS>
+    //  <addr> is a 12-digit hex value
+    //  <short_name> is a string, surrounded by carets ( <like this> )
+    //  <role> is advertising flags. BC127 devices will show up as 0A; single mode
+    //    devices as 02.
+    //  <RSS> is the signal strength. Anything better than -70dBm is likely to be
+    //    quite okay for connecting.
+    case REPLY_SCAN:
+      if (lineStartsWith(F("OK"))) return (opResult)_numAddresses;
+      if (lineStartsWith(F("ER"))) return MODULE_ERROR;
+      if (lineStartsWith(F("SC"))) return addressFound(5);
+      break;
+#endif
+    default:
+      break;
+  }
+  return IN_PROGRESS;
+}
+
+// Whatever line we get from the module tells us it's alive, and may be part of
+//  a boot banner or (events can turn up in the middle of any reply) an event.
+void BC127::noteLine()
+{
+  _lastHeard = millis();
+  _unanswered = false;
+  noteBanner();
+#if BC127_ENABLE_AUDIO
+  noteEvent();
+#endif
+#if BC127_ENABLE_DATA_MODE
+  // When the link that data mode was using closes or is lost, the module drops
+  //  back into command mode by itself, and tells us about the link.
+  if (_dataMode && (lineStartsWith(F("LINK_LOSS")) ||
+      (lineStartsWith(F("CLOSE_OK")) &&
+       (strstr(_lineBuf, " SPP") != NULL || strstr(_lineBuf, " BLE") != NULL))))
+    _dataMode = false;
+#endif
+}
+
+// Read every complete line that's already arrived, for what noteLine() can
+//  make of it. Nothing waits here. A partial line is left in the line buffer,
+//  so the caller can pick up where we left off (see checkEvents()) or throw it
+//  away.
+void BC127::noteLines()
+{
+  while (portPollLine())
+  {
+    noteLine();
+    lineClear();
+  }
+}
+
+// Send the command we've built without waiting for the reply. Rather than
+//  running knownStart(), which would block, we read whatever's already in our
+//  receive buffer and put a "\r" ahead of the command; asyncPoll() skips the
+//  module's answer to that.
+BC127::opResult BC127::asyncSend(replyTypes type, unsigned long timeout)
+{
+  if (_cmdOverflow)
+  {
+    _asyncState = ASYNC_IDLE;
+    return INVALID_PARAM;
+  }
+  if (_offline && type != REPLY_PING)
+  {
+    _asyncState = ASYNC_IDLE;
+    return TIMEOUT_ERROR;
+  }
+  // The command is in the line buffer, so it has to be moved out of the way
+  //  while we catch up with what's waiting; that's most likely events, and
+  //  we don't want to lose them.
+  char command[LINE_BUF_LEN];
+  byte commandLen = _lineLen;
+  memcpy(command, _lineBuf, commandLen);
+  lineClear();
+  noteLines();
+  memcpy(_lineBuf, command, commandLen);
+  _lineLen = commandLen;
+  
+  // An empty command is just the "\r" itself, so there's nothing to skip.
+  boolean empty = (_lineLen == 0);
+  portWrite("\r", 1);
+  if (!empty) cmdWrite();
+  lineClear();
+#if BC127_ENABLE_AUDIO
+  _asyncMusic = NO_MUSIC;
+  _asyncVolume = -1;
+#endif
+  _asyncTag++;
+  _asyncReply = type;
+  _asyncTimeout = timeout;
+  _asyncStart = millis();
+  _asyncState = empty ? ASYNC_REPLY : ASYNC_SKIP;
+  return IN_PROGRESS;
+}
+
+// Check on the outstanding non-blocking command. This only ever reads what's
+//  already arrived, so it's safe to call as often as you like.
+BC127::opResult BC127::asyncPoll()
+{
+  if (_asyncState == ASYNC_IDLE) return INVALID_PARAM;
+  if (_asyncState == ASYNC_DONE)
+  {
+    _asyncState = ASYNC_IDLE;
+    return _asyncResult;
+  }
+  
+  while (portPollLine())
+  {
+    // The first ERROR is the answer to the "\r". An event can still arrive
+    //  ahead of it, and a RESET can lose it altogether, so anything else goes
+    //  through parseReply() as usual.
+    if (_asyncState == ASYNC_SKIP && lineStartsWith(F("ER")))
+    {
+      noteLine();
+      _asyncState = ASYNC_REPLY;
+    }
+    else
+    {
+      opResult result = parseReply((replyTypes)_asyncReply);
+      if (result != IN_PROGRESS)
+      {
+        _asyncState = ASYNC_IDLE;
+        lineClear();
+        if (result == SUCCESS && _asyncReply == REPLY_OPEN)
+          notePeer(_asyncPeer, (connType)_asyncProfile);
+#if BC127_ENABLE_AUDIO
+        if (result == SUCCESS && _asyncMusic != NO_MUSIC)
+          noteMusic((audioCmds)_asyncMusic);
+        if (result == SUCCESS && _asyncVolume >= 0) _volume = _asyncVolume;
+#endif
+        return result;
+      }
+    }
+    lineClear();
+  }
+  
+  if (millis() - _asyncStart >= _asyncTimeout)
+  {
+    _asyncState = ASYNC_IDLE;
+    return TIMEOUT_ERROR;
+  }
+  return IN_PROGRESS;
+}
+
+boolean BC127::asyncBusy()
+{
+  return _asyncState != ASYNC_IDLE;
+}
+
+byte BC127::asyncTag()
+{
+  return _asyncTag;
+}
+
+BC127::opResult BC127::stdCmdAsync(const char *command)
+{
+  cmdStart();
+  cmdAppend(command);
+  return asyncSend(REPLY_OK, 3000);
+}
+
+BC127::opResult BC127::stdCmdAsync(const __FlashStringHelper *command)
+{
+  cmdStart();
+  cmdAppend(command);
+  return asyncSend(REPLY_OK, 3000);
+}
+
+BC127::opResult BC127::resetAsync()
+{
+  cmdStart();
+  cmdAppend(C_RESET);
+  opResult result = asyncSend(REPLY_RESET, 2000);
+  _resetStart = millis();
+  _awaitingCommand = false;
+  return result;
+}
+
+// An empty command; the module answers "ERROR" to it, and that's all we need
+//  to know it's alive.
+BC127::opResult BC127::pingAsync(unsigned long timeout)
+{
+  cmdStart();
+  return asyncSend(REPLY_PING, timeout);
+}
+
+void BC127::setOffline(boolean offline)
+{
+  _offline = offline;
+}
+
+boolean BC127::offline()
+{
+  return _offline;
+}
+
+void BC127::setOfflineOnSilence(boolean enable)
+{
+  _silenceOffline = enable;
+}
+
+boolean BC127::dataMode()
+{
+  return _dataMode;
+}
+
+unsigned long BC127::lastHeard()
+{
+  return _lastHeard;
+}
+
+boolean BC127::unanswered()
+{
+  return _unanswered;
+}
+
+// Keep track of who we last connected to, so we can find our way back to
+//  them (see BC127Reconnect). A new address starts a new set of profiles.
+void BC127::notePeer(const char *address, connType connection)
+{
+  if (strcmp(address, _lastPeer) != 0)
+  {
+    strncpy(_lastPeer, address, ADDR_LEN - 1);
+    _lastPeer[ADDR_LEN - 1] = '\0';
+    _lastProfiles = 0;
+  }
+  _lastProfiles |= (1 << connection);
+}
+
+const char *BC127::lastPeer()
+{
+  return _lastPeer;
+}
+
+byte BC127::lastProfiles()
+{
+  return _lastProfiles;
+}
+
+// Shortcuts for the commands and parameters we use internally, straight
+//  from the string table.
+BC127::opResult BC127::simpleCmd(cmdStrings index)
+{
+  if (knownStart() != SUCCESS) return TIMEOUT_ERROR;
+  cmdStart();
+  cmdAppend(index);
+  return cmdSend(3000);
+}
+
+BC127::opResult BC127::setParam(cmdStrings name, cmdStrings value)
+{
+  if (knownStart() != SUCCESS) return TIMEOUT_ERROR;
+  cmdStart();
+  cmdAppend(C_SET);
+  cmdAppend(cmdString(name));
+  cmdAppend(F("="));
+  cmdAppend(cmdString(value));
+  return cmdSend(2000);
 }
 
 // It may be useful to know the address of this module. This function will
 //  pack it into a string for you.
 BC127::opResult BC127::addressQuery(String &address)
 {
-  return stdGetParam("LOCAL_ADDR", &address);
+  char temp[ADDR_LEN];
+  opResult result = addressQuery(temp);
+  address = temp;
+  return result;
+}
+
+// Same again, but into a buffer that's at least ADDR_LEN characters long.
+BC127::opResult BC127::addressQuery(char *address)
+{
+  return stdGetParam(cmdString(C_LOCAL_ADDR), address, ADDR_LEN);
 }
   
 
@@ -38,36 +641,9 @@ BC127::opResult BC127::addressQuery(String &address)
 //  we can assume something is radically wrong. 
 BC127::opResult BC127::setBaudRate(baudRates newSpeed)
 {
-  // The BC127 wants a string, but the .begin() functions want an integer. We
-  //  need a variable to hold both types.
-  int intSpeed;
-  String stringSpeed;
-  
-  // Convert our enum values into strings the module can use.
-  switch(newSpeed)
-  {
-    case BC127::s9600bps:
-      stringSpeed = "9600";
-      break;
-    case BC127::s19200bps:
-      stringSpeed = "19200";
-      break;
-    case BC127::s38400bps:
-      stringSpeed = "38400";
-      break;
-    case BC127::s57600bps:
-      stringSpeed = "57600";
-      break;
-    case BC127::s115200bps:
-      stringSpeed = "115200";
-      break;
-    default:
-      return INVALID_PARAM;
-  }
-  
-  // If we've made it to here, we had a valid input to the function and should
-  //  send it off to the set parameter function.
-  intSpeed = stringSpeed.toInt();  
+  // Rather than switching on the enum, we rely on the speed strings being in
+  //  the same order as the baudRates enum in our string table.
+  if (newSpeed < s9600bps || newSpeed > s115200bps) return INVALID_PARAM;
   
   // So, there are three possibilities here: SUCCESS, MODULE_ERROR, and
   //  TIMEOUT_ERROR. SUCCESS indicates that you just set the baud rate to the
@@ -79,141 +655,183 @@ BC127::opResult BC127::setBaudRate(baudRates newSpeed)
   //  the inheritance of the Stream class to manipulate our serial ports, we
   //  can't change the baud rate. The user should probably just interpret 
   //  TIMEOUT_ERROR as success, and call it good.
-  return stdSetParam("BAUD", stringSpeed);
+  return setParam(C_BAUD, (cmdStrings)(C_9600 + newSpeed));
 }
 
 // There are several commands that look for either OK or ERROR; let's abstract
-//  support for those commands to one single private function, to save memory.
-BC127::opResult BC127::stdCmd(String command)
+//  support for those commands to one single function, to save memory.
+BC127::opResult BC127::stdCmd(const String &command)
 {
-  String buffer;
-  String EOL = String("\n\r");
-  
-  knownStart(); // Clear the serial buffer in the module and the Arduino.
-  
-  _serialPort->print(command);
-  _serialPort->print("\r");
-  _serialPort->flush();
-  
-  // We're going to use the internal timer to track the elapsed time since we
-  //  issued the command. Bog-standard Arduino stuff.
-  unsigned long startTime = millis();
-    
-  // This is our timeout loop. We'll give the module 3 seconds.
-  while ((startTime + 3000) > millis())
-  {
-    // Grow the current buffered data, until we receive the EOL string.    
-    if (_serialPort->available() > 0) buffer.concat(char(_serialPort->read()));
+  return stdCmd(command.c_str());
+}
 
-    if (buffer.endsWith(EOL))
-    {
-      if (buffer.startsWith("ER")) return MODULE_ERROR;
-      if (buffer.startsWith("OK")) return SUCCESS;
-      buffer = "";
-    }    
-  }
-  return TIMEOUT_ERROR;
+BC127::opResult BC127::stdCmd(const char *command)
+{
+  // Clear the serial buffer in the module and the Arduino. If the module
+  //  doesn't answer that, it won't answer the command either.
+  if (knownStart() != SUCCESS) return TIMEOUT_ERROR;
+  cmdStart();
+  cmdAppend(command);
+  // We'll give the module 3 seconds.
+  return cmdSend(3000);
+}
+
+BC127::opResult BC127::stdCmd(const __FlashStringHelper *command)
+{
+  if (knownStart() != SUCCESS) return TIMEOUT_ERROR;
+  cmdStart();
+  cmdAppend(command);
+  return cmdSend(3000);
 }
 
 // Similar to the command function, let's do a set parameter genrealization.
-BC127::opResult BC127::stdSetParam(String command, String param)
+BC127::opResult BC127::stdSetParam(const String &command, const String &param)
 {
-  String buffer;
-  String EOL = String("\n\r");
-  
-  knownStart();  // Clear Arduino and module serial buffers.
-  
-  _serialPort->print("SET ");
-  _serialPort->print(command);
-  _serialPort->print("=");
-  _serialPort->print(param);
-  _serialPort->print("\r");
-  _serialPort->flush();
-  
-  // We're going to use the internal timer to track the elapsed time since we
-  //  issued the reset. Bog-standard Arduino stuff.
-  unsigned long startTime = millis();
-  
-  // This is our timeout loop. We'll give the module 2 seconds to reset.
-  while ((startTime + 2000) > millis())
-  {
-    // Grow the current buffered data, until we receive the EOL string.    
-    if (_serialPort->available() >0) buffer.concat(char(_serialPort->read()));
+  return stdSetParam(command.c_str(), param.c_str());
+}
 
-    if (buffer.endsWith(EOL))
-    {
-      if (buffer.startsWith("ER")) return MODULE_ERROR;
-      else if (buffer.startsWith("OK")) return SUCCESS;
-      buffer = "";
-    }    
-  }
-  return TIMEOUT_ERROR;
+BC127::opResult BC127::stdSetParam(const char *command, const char *param)
+{
+  // Clear Arduino and module serial buffers.
+  if (knownStart() != SUCCESS) return TIMEOUT_ERROR;
+  cmdStart();
+  cmdAppend(C_SET);
+  cmdAppend(command);
+  cmdAppend(F("="));
+  cmdAppend(param);
+  // We'll give the module 2 seconds to respond.
+  return cmdSend(2000);
+}
+
+BC127::opResult BC127::stdSetParam(const __FlashStringHelper *command,
+                                   const char *param)
+{
+  if (knownStart() != SUCCESS) return TIMEOUT_ERROR;
+  cmdStart();
+  cmdAppend(C_SET);
+  cmdAppend(command);
+  cmdAppend(F("="));
+  cmdAppend(param);
+  return cmdSend(2000);
 }
 
 // Also, do a get paramater generalization. This is, of course, a bit more
 //  difficult; we need to return both the result (SUCCESS/ERROR) and the
 //  string returned.
-BC127::opResult BC127::stdGetParam(String command, String *param)
+BC127::opResult BC127::stdGetParam(const String &command, String *param)
 {
-  String buffer;
-  String EOL = String("\n\r");
-  
-  knownStart();  // Clear the serial buffers.
-  
-  _serialPort->print("GET ");
-  _serialPort->print(command);
-  _serialPort->print("\r");
-  _serialPort->flush();
+  char temp[LINE_BUF_LEN];
+  opResult result = stdGetParam(command.c_str(), temp, sizeof(temp));
+  if (result == SUCCESS) (*param) = temp;
+  return result;
+}
+
+BC127::opResult BC127::stdGetParam(const char *command, char *param,
+                                   size_t paramLen)
+{
+  // Clear the serial buffers.
+  if (knownStart() != SUCCESS) return TIMEOUT_ERROR;
+  cmdStart();
+  cmdAppend(C_GET);
+  cmdAppend(command);
+  return getParamReply(command, false, param, paramLen);
+}
+
+BC127::opResult BC127::stdGetParam(const __FlashStringHelper *command,
+                                   char *param, size_t paramLen)
+{
+  if (knownStart() != SUCCESS) return TIMEOUT_ERROR;
+  cmdStart();
+  cmdAppend(C_GET);
+  cmdAppend(command);
+  return getParamReply(reinterpret_cast<PGM_P>(command), true, param,
+                       paramLen);
+}
+
+// Remember where the value of a GET is to go, for parseReply(). The name may
+//  be in flash or RAM; either way, it has to stay put until the reply is in.
+boolean BC127::getParamStart(const char *name, boolean nameInFlash,
+                             char *param, size_t paramLen)
+{
+  if (paramLen == 0) return false;
+  param[0] = '\0';
+  _getName = name;
+  _getNameInFlash = nameInFlash;
+  _getParam = param;
+  _getParamLen = paramLen;
+  return true;
+}
+
+// Send a GET command that's already been built, and pick the value out of the
+//  reply, which looks like "<name>=<value>".
+BC127::opResult BC127::getParamReply(const char *name, boolean nameInFlash,
+                                     char *param, size_t paramLen)
+{
+  if (!getParamStart(name, nameInFlash, param, paramLen)) return INVALID_PARAM;
+  if (!cmdWrite()) return _offline ? TIMEOUT_ERROR : INVALID_PARAM;
   
   // We're going to use the internal timer to track the elapsed time since we
   //  issued the get command. Bog-standard Arduino stuff.
   unsigned long loopStart = millis();
   
   // This is our timeout loop. We'll give the module 2 seconds to get the value.
-  while (loopStart + 2000 > millis())
+  while (portReadLine(loopStart, 2000))
   {
-    // Grow the current buffered data, until we receive the EOL string.    
-    if (_serialPort->available() >0) buffer.concat(char(_serialPort->read()));
-
-    if (buffer.endsWith(EOL))
-    {
-      if (buffer.startsWith("ER")) return MODULE_ERROR;
-      if (buffer.startsWith("OK")) return SUCCESS;
-      if (buffer.startsWith(command))
-      {
-        (*param) = buffer.substring(command.length()+1);
-        (*param).trim();
-      }
-      buffer = "";
-    }    
+    opResult result = parseReply(REPLY_GET);
+    if (result != IN_PROGRESS) return result;
   }
   return TIMEOUT_ERROR;
 }
 
+// The non-blocking GETs. command and param both have to stay put until
+//  asyncPoll() says we're done.
+BC127::opResult BC127::stdGetParamAsync(const char *command, char *param,
+                                        size_t paramLen)
+{
+  if (!getParamStart(command, false, param, paramLen)) return INVALID_PARAM;
+  cmdStart();
+  cmdAppend(C_GET);
+  cmdAppend(command);
+  return asyncSend(REPLY_GET, 2000);
+}
+
+BC127::opResult BC127::stdGetParamAsync(const __FlashStringHelper *command,
+                                        char *param, size_t paramLen)
+{
+  if (!getParamStart(reinterpret_cast<PGM_P>(command), true, param, paramLen))
+    return INVALID_PARAM;
+  cmdStart();
+  cmdAppend(C_GET);
+  cmdAppend(command);
+  return asyncSend(REPLY_GET, 2000);
+}
+
+#if BC127_ENABLE_BLE
 // The BLE role of the device is important: it can be either Central, Peripheral,
 //   or disabled. We've provided one function for each of these. Note that to
 //   get a change of mode to "take", a write/reset cycle is required.
 BC127::opResult BC127::BLEDisable()
 {
-  return stdSetParam("BLE_ROLE", "0");
+  return setParam(C_BLE_ROLE, C_ZERO);
 }
 
 BC127::opResult BC127::BLECentral()
 {
-  return stdSetParam("BLE_ROLE", "2");
+  return setParam(C_BLE_ROLE, C_TWO);
 }
 
 BC127::opResult BC127::BLEPeripheral()
 {
-  return stdSetParam("BLE_ROLE", "1");
+  return setParam(C_BLE_ROLE, C_ONE);
 }
+#endif
 
 // Issue the "RESTORE" command over the serial port to the BC127. This will
 //  reset the device to factory default settings, which is a good thing to do
 //  once in a while.
 BC127::opResult BC127::restore()
 {
-  return stdCmd("RESTORE");
+  return simpleCmd(C_RESTORE);
 }
 
 // Issue the "WRITE" command over the serial port to the BC127. This will
@@ -221,7 +839,7 @@ BC127::opResult BC127::restore()
 //  or power cycle.
 BC127::opResult BC127::writeConfig()
 {
-  return stdCmd("WRITE");
+  return simpleCmd(C_WRITE);
 }
 
 // Issue the "RESET" command over the serial port to the BC127. If it works, 
@@ -234,68 +852,148 @@ BC127::opResult BC127::writeConfig()
 // We'll buffer characters until we see an EOL (\n\r), then check the string.
 BC127::opResult BC127::reset()
 {
-  String buffer;
-  String EOL = String("\n\r");
-  
-  knownStart();
+  if (knownStart() != SUCCESS) return TIMEOUT_ERROR;
   
   // Now issue the reset command.
-  _serialPort->print("RESET");
-  _serialPort->print("\r");
-  _serialPort->flush();
+  cmdStart();
+  cmdAppend(C_RESET);
+  cmdWrite();
   
   // We're going to use the internal timer to track the elapsed time since we
   //  issued the reset. Bog-standard Arduino stuff.
-  unsigned long resetStart = millis();
+  _resetStart = millis();
+  _awaitingCommand = false;
   
   // This is our timeout loop. We'll give the module 2 seconds to reset.
-  while ((resetStart + 2000) > millis())
+  while (portReadLine(_resetStart, 2000))
+  {
+    opResult result = parseReply(REPLY_RESET);
+    if (result != IN_PROGRESS) return result;
+  }
+  return TIMEOUT_ERROR;
+}
+
+// Pick what we can out of the boot banner as it goes past. This gets a look at
+//  every line, not just the replies to reset(), so a banner from the module
+//  powering up is caught too if a command happens to be waiting at the time.
+void BC127::noteBanner()
+{
+  if (lineStartsWith(F("Melody")))
   {
-    // Grow the current buffered data, until we receive the EOL string.    
-    if (_serialPort->available() > 0) 
+    // The version starts at the first "V" followed by a digit.
+    const char *version = _lineBuf;
+    while (*version != '\0' &&
+           !(version[0] == 'V' && version[1] >= '0' && version[1] <= '9'))
+      version++;
+    if (*version == '\0') return;
+    
+    byte len = 0;
+    while (len < VERSION_LEN - 1 && version[len] != '\0' &&
+           version[len] != '\n' && version[len] != '\r')
     {
-      char temp = _serialPort->read();
-      buffer.concat(temp);
+      _firmware[len] = version[len];
+      len++;
     }
+    _firmware[len] = '\0';
     
-    if (buffer.endsWith(EOL))
-    {
-      if (buffer.startsWith("ER")) return MODULE_ERROR;
-      if (buffer.startsWith("Re")) return SUCCESS;
-      buffer = "";
-    }    
+    _firmwareMajor = atoi(version + 1);
+    const char *dot = strchr(version, '.');
+    _firmwareMinor = (dot != NULL) ? atoi(dot + 1) : 0;
   }
-  return TIMEOUT_ERROR;
+  else if (lineStartsWith(F("Build")))
+  {
+    const char *number = _lineBuf;
+    while (*number != '\0' && (*number < '0' || *number > '9')) number++;
+    _firmwareBuild = atol(number);
+  }
+}
+
+const char *BC127::firmwareVersion()
+{
+  return _firmware;
+}
+
+byte BC127::firmwareMajor()
+{
+  return _firmwareMajor;
+}
+
+byte BC127::firmwareMinor()
+{
+  return _firmwareMinor;
+}
+
+unsigned long BC127::firmwareBuild()
+{
+  return _firmwareBuild;
+}
+
+unsigned long BC127::bootTime()
+{
+  return _bootTime;
+}
+
+unsigned long BC127::bootToFirstCommand()
+{
+  return _firstCommand;
 }
 
 // Create a known state for the module to start from. If a partial command is
 //  already in the module's buffer, we can purge it by sending an EOL to the
-//  the module. If not, we'll just get an error.
+//  the module. If not, we'll just get an error. Returns TIMEOUT_ERROR if the
+//  module said nothing at all, in which case there's no point sending it the
+//  command; anything else it says shows it's alive, and we carry on.
 BC127::opResult BC127::knownStart()
 {
-  String EOL = String("\n\r");
-  String buffer = "";
+  // If the module's been marked offline, don't even try, and leave alone the
+  //  probe that's checking whether it's back.
+  if (_offline) return TIMEOUT_ERROR;
   
-  _serialPort->print("\r");
-  _serialPort->flush();
+  // A non-blocking command that's still running gets to finish first. If we
+  //  cut in, its reply would be taken for the answer to our "\r", and our
+  //  answer for the reply to the command we're about to send. Whoever started
+  //  it collects the result from asyncPoll() as usual.
+  if (_asyncState == ASYNC_SKIP || _asyncState == ASYNC_REPLY)
+  {
+    opResult result;
+    do result = asyncPoll(); while (result == IN_PROGRESS);
+    _asyncResult = result;
+    _asyncState = ASYNC_DONE;
+  }
+  
+  // Anything that's already arrived is from before our "\r"; events, most
+  //  likely, which we want to hear about.
+  lineClear();
+  noteLines();
+  
+  cmdStart();
+  cmdWrite();
   
   // We're going to use the internal timer to track the elapsed time since we
   //  issued the reset. Bog-standard Arduino stuff.
   unsigned long startTime = millis();
   
-  // This is our timeout loop. We're going to give our module 100ms to come up
-  //  with a new character, and return with a timeout failure otherwise.
-  while (buffer.endsWith(EOL) != true)
+  // This is our timeout loop. The module answers the "\r" in a few ms, even at
+  //  9600 baud, so we give it 100ms to come up with a new character. An event
+  //  can still turn up ahead of the answer, so we keep reading until we see
+  //  the ERROR.
+  boolean heard = false;
+  while (portReadLine(startTime, 100, true))
   {
-    // Purge the serial data received from the module, along with any data in
-    //  the buffer at the time this command was sent.
-    if (_serialPort->available() >0) 
-    {
-      buffer.concat(char(_serialPort->read()));
-      startTime = millis();
-    }
-    if ((startTime + 1000) < millis()) return TIMEOUT_ERROR;
+    noteLine();
+    heard = true;
+    if (lineStartsWith(F("ER"))) return SUCCESS;
   }
-  if (buffer.startsWith("ERR")) return SUCCESS;
-  else return SUCCESS;
+  if (heard) return SUCCESS;
+  
+  // Not a peep. In data mode, that's to be expected: the "\r" went over the
+  //  air. Otherwise the module's in trouble, and if somebody's watching it
+  //  (see setOfflineOnSilence()), we mark it offline now, so the commands
+  //  after this one don't wait for it either.
+  if (!_dataMode)
+  {
+    _unanswered = true;
+    if (_silenceOffline) _offline = true;
+  }
+  return TIMEOUT_ERROR;
 }
@@ -15,6 +15,7 @@ Code developed in Arduino 1.0.5, on an Arduino Pro Mini 5V.
 
 #include <Arduino.h>
 #include <SoftwareSerial.h>
+#include "SparkFunbc127config.h"
 
 
 class BC127 
@@ -25,51 +26,396 @@ class BC127
     // but we'll only actually use a few of them.
     enum connType {SPP, BLE, A2DP, HFP, AVRCP, PBAP, ANY};
 
-    // Now, make a data type for function results.
-    enum opResult {REMOTE_ERROR = -5, CONNECT_ERROR, INVALID_PARAM,
-                 TIMEOUT_ERROR, MODULE_ERROR, DEFAULT_ERR, SUCCESS};
+    // Now, make a data type for function results. IN_PROGRESS is only ever
+    //  returned by the non-blocking functions.
+    enum opResult {IN_PROGRESS = -6, REMOTE_ERROR = -5, CONNECT_ERROR,
+                 INVALID_PARAM, TIMEOUT_ERROR, MODULE_ERROR, DEFAULT_ERR,
+                 SUCCESS};
 
     // enum for the various audio commands we can use on the module.
     enum audioCmds {PLAY, PAUSE, FORWARD, BACK, UP, DOWN, STOP};
     
+    // What the player at the other end is doing, as far as we know, and the
+    //  top of the module's volume range.
+    enum playStates {PLAY_UNKNOWN, PLAYING, PAUSED, STOPPED};
+    enum volumeLimits {VOLUME_MAX = 15};
+    
     // enum for the various valid baud rates. Rather than doing it
     //  with strings, we'll use the enum, to discourage people from 
     //  experimenting with out-of-bounds speeds.
     enum baudRates {s9600bps, s19200bps, s38400bps, 
                     s57600bps, s115200bps};
     
+    // Size of the buffer used to hold one line of text to or from the module,
+    //  and of the buffer needed to hold an address (12 hex digits plus the
+    //  terminating null). Anything longer than a line is truncated, and so is
+    //  a firmware version longer than VERSION_LEN - 1 characters.
+    enum bufSizes {LINE_BUF_LEN = 64, ADDR_LEN = 13, VERSION_LEN = 16};
+
     BC127(Stream* sp);
     opResult reset();
     opResult restore();
     opResult writeConfig();
+#if BC127_ENABLE_CLASSIC_DISCOVERY
     opResult inquiry(int timeout);
+#endif
+#if BC127_ENABLE_ADDRESS_TABLE
     opResult connect(char index, connType connection);
-    opResult connect(String address, connType connection);
     opResult getAddress(char index, String &address);
+    opResult getAddress(char index, char *address);
+#endif
+    opResult connect(const String &address, connType connection);
+    opResult connect(const char *address, connType connection);
+#if BC127_ENABLE_DATA_MODE
     opResult exitDataMode(int guardDelay=420);
     opResult enterDataMode();
+#endif
+    // True from a successful enterDataMode() until exitDataMode(), a reset, or
+    //  the module telling us the link has closed or been lost (which we see
+    //  the next time anything here reads from it). Anything we send in the
+    //  meantime goes over the air to the other end.
+    boolean dataMode();
+#if BC127_ENABLE_BLE
     opResult BLEDisable();
     opResult BLECentral();
     opResult BLEPeripheral();
     opResult BLEAdvertise();
     opResult BLENoAdvertise();
     opResult BLEScan(int timeout);
+#endif
     opResult setBaudRate(baudRates newSpeed);
+#if BC127_ENABLE_AUDIO
     opResult musicCommands(audioCmds command);
+    opResult setVolume(byte level);
+    // The volume (0 to VOLUME_MAX, or -1 if we don't know it yet) and play
+    //  state, as of the last command we sent or event the module told us
+    //  about. Reading these never touches the serial port; call
+    //  checkEvents() from loop() to pick up events between commands.
+    int volume();
+    playStates playState();
+    void checkEvents();
+#endif
     opResult addressQuery(String &address);
+    opResult addressQuery(char *address);
+#if BC127_ENABLE_AUDIO
     opResult setClassicSink();
     opResult setClassicSource();
-    opResult stdGetParam(String command, String *param);
-    opResult stdSetParam(String command, String param);
-    opResult stdCmd(String command);
+#endif
+    // The String versions of these are handy, but every String lives on the
+    //  heap. The const char* and F("...") versions never allocate; for
+    //  stdGetParam(), param must have room for paramLen characters, including
+    //  the terminating null.
+    opResult stdGetParam(const String &command, String *param);
+    opResult stdGetParam(const char *command, char *param, size_t paramLen);
+    opResult stdGetParam(const __FlashStringHelper *command, char *param,
+                         size_t paramLen);
+    opResult stdSetParam(const String &command, const String &param);
+    opResult stdSetParam(const char *command, const char *param);
+    opResult stdSetParam(const __FlashStringHelper *command, const char *param);
+    opResult stdCmd(const String &command);
+    opResult stdCmd(const char *command);
+    opResult stdCmd(const __FlashStringHelper *command);
     opResult connectionState();
+    
+    // Non-blocking versions of a few of the above. These send the command and
+    //  return right away; call asyncPoll() from loop() until it returns
+    //  something other than IN_PROGRESS. Only one can be outstanding at a
+    //  time. Calling one of the blocking functions while it's running makes
+    //  that function wait for it to finish first; the result is kept for
+    //  asyncPoll(), and asyncBusy() stays true until it's been collected.
+    opResult connectAsync(const char *address, connType connection);
+    opResult stdCmdAsync(const char *command);
+    opResult stdCmdAsync(const __FlashStringHelper *command);
+    opResult stdGetParamAsync(const char *command, char *param,
+                              size_t paramLen);
+    opResult stdGetParamAsync(const __FlashStringHelper *command, char *param,
+                              size_t paramLen);
+    opResult connectionStateAsync();
+#if BC127_ENABLE_AUDIO
+    opResult musicCommandsAsync(audioCmds command);
+    opResult setVolumeAsync(byte level);
+#endif
+    opResult resetAsync();
+#if BC127_ENABLE_CLASSIC_DISCOVERY
+    opResult inquiryAsync(int timeout);
+#endif
+#if BC127_ENABLE_BLE
+    opResult BLEScanAsync(int timeout);
+#endif
+    // Send the smallest thing the module will answer (an empty line), and
+    //  see if it does. Used by BC127Health; works even when offline.
+    opResult pingAsync(unsigned long timeout);
+    opResult asyncPoll();
+    boolean asyncBusy();
+    // There's only the one non-blocking command per module, so anything that
+    //  shares it has to take turns. asyncTag() changes every time a command
+    //  starts. BC127Group, BC127Health, BC127Remote and BC127Reconnect wait
+    //  until asyncBusy() is false before they start a command, and check that
+    //  the tag is still the one they got before they collect a result, so any
+    //  of them can share a module with the others. BC127Group, which may
+    //  always have another command waiting, leaves the module free for a pass
+    //  after each one so the others aren't shut out. Your own non-blocking
+    //  commands can join in if they play by the same rules.
+    byte asyncTag();
+    
+    // When the module is marked offline, nothing waits on it any more: the
+    //  blocking functions fail with TIMEOUT_ERROR straight away, and the
+    //  non-blocking ones won't start. BC127Health does this when the module
+    //  stops answering. lastHeard() is the millis() time of the last line we
+    //  got from the module; unanswered() is true if a blocking command got
+    //  nothing back at all, and we've heard nothing since.
+    //
+    // Every blocking function starts by sending the module an empty line. If
+    //  nothing at all comes back within 100ms, the function gives up with
+    //  TIMEOUT_ERROR without sending its command. With setOfflineOnSilence()
+    //  turned on, it also marks the module offline, so the next call doesn't
+    //  wait either. Only turn that on if something will bring the module back
+    //  online; BC127Health turns it on for the module it's watching.
+    void setOffline(boolean offline);
+    boolean offline();
+    void setOfflineOnSilence(boolean enable);
+    unsigned long lastHeard();
+    boolean unanswered();
+    
+    // The last device we opened a connection to, and which profiles we opened
+    //  with it (bit (1 << connType) set for each). lastPeer() is an empty
+    //  string until the first successful connect().
+    const char *lastPeer();
+    byte lastProfiles();
+    
+    // What the module told us about itself the last time we saw it boot. The
+    //  version line looks like "Melody Audio V5.0 RC9", which gives "V5.0 RC9",
+    //  major 5 and minor 0; firmware that reports a build number does so on a
+    //  line of its own. Everything is empty or zero until we've seen a
+    //  banner, which normally means until the first reset().
+    const char *firmwareVersion();
+    byte firmwareMajor();
+    byte firmwareMinor();
+    unsigned long firmwareBuild();
+    // How long the last reset took, in milliseconds: from sending RESET to
+    //  "Ready", and from sending RESET to the next command going out (not
+    //  counting the empty line that goes ahead of a blocking command).
+    unsigned long bootTime();
+    unsigned long bootToFirstCommand();
+  protected:
+    // These are the only three functions which touch the serial port. The
+    //  default versions talk to a Stream through its virtual functions; the
+    //  BC127Port template below replaces them with versions that know the
+    //  concrete port type, so the per-byte calls can be bound at compile time.
+    virtual void portWrite(const char *buffer, size_t length);
+    virtual boolean portReadLine(unsigned long startTime, unsigned long timeout,
+                                 boolean restartOnData = false);
+    virtual void portPurge();
+    // Read whatever is waiting without blocking; returns true once a full
+    //  line has arrived. Unlike portReadLine(), this doesn't clear the line
+    //  buffer first, so a line can be collected over several calls.
+    virtual boolean portPollLine();
+
+    // Append one received character to the line buffer. Returns true when the
+    //  EOL string ("\n\r") has just been completed. Characters beyond the end
+    //  of the buffer are dropped, but EOL detection keeps working.
+    boolean lineAppend(char c)
+    {
+      boolean eol = (c == '\r') && (_linePrev == '\n');
+      _linePrev = c;
+      if (_lineLen < LINE_BUF_LEN - 1)
+      {
+        _lineBuf[_lineLen++] = c;
+        _lineBuf[_lineLen] = '\0';
+      }
+      return eol;
+    }
+    void lineClear()
+    {
+      _lineLen = 0;
+      _lineBuf[0] = '\0';
+      _linePrev = '\0';
+    }
+    boolean lineStartsWith(const __FlashStringHelper *prefix)
+    {
+      PGM_P p = reinterpret_cast<PGM_P>(prefix);
+      return strncmp_P(_lineBuf, p, strlen_P(p)) == 0;
+    }
+    
+    char _lineBuf[LINE_BUF_LEN];
+    unsigned char _lineLen;
+    char _linePrev;
   private:
+    // Every fixed string we send to the module lives in a table in flash
+    //  (see SparkFunbc127.cpp); these are the indices into that table. Some
+    //  runs are laid out in the same order as the public enums above, so
+    //  the public enum value can be added to the first entry of the run.
+    //  Strings that only belong to a feature are left out with it, so the
+    //  #if blocks here have to match the ones around the table.
+    enum cmdStrings {C_RESTORE, C_WRITE, C_RESET, C_STATUS, C_SET, C_GET,
+                     C_OPEN, C_BAUD, C_LOCAL_ADDR, C_ZERO, C_ONE, C_TWO,
+#if BC127_ENABLE_DATA_MODE
+                     C_ENTER_DATA,
+#endif
+#if BC127_ENABLE_CLASSIC_DISCOVERY
+                     C_INQUIRY,
+#endif
+#if BC127_ENABLE_BLE
+                     C_ADV_ON, C_ADV_OFF, C_SCAN, C_BLE_ROLE,
+#endif
+#if BC127_ENABLE_AUDIO
+                     C_CLASSIC_ROLE,
+                     // Same order as audioCmds.
+                     C_MUSIC_PLAY, C_MUSIC_PAUSE, C_MUSIC_FORWARD,
+                     C_MUSIC_BACK, C_VOLUME_UP, C_VOLUME_DOWN, C_MUSIC_STOP,
+                     C_VOLUME,
+#endif
+                     // Same order as connType.
+                     C_SPP, C_BLE, C_A2DP, C_HFP, C_AVRCP, C_PBAP,
+                     // Same order as baudRates.
+                     C_9600, C_19200, C_38400, C_57600, C_115200};
+    static const __FlashStringHelper *cmdString(cmdStrings index);
+
     BC127();
     int _baudRate;
-    String _addresses[5];
+#if BC127_ENABLE_ADDRESS_TABLE
+    char _addresses[5][ADDR_LEN];
     char _numAddresses;
+#endif
     Stream *_serialPort;
+    boolean _cmdOverflow;
     opResult knownStart();
+    // Outgoing commands are assembled in _lineBuf (we never need it for a
+    //  command and a reply at the same time) and sent in one write by
+    //  cmdSend(), which then waits up to timeout ms for OK or ERROR.
+    void cmdStart();
+    void cmdAppend(const char *part);
+    void cmdAppend(const __FlashStringHelper *part);
+    void cmdAppend(cmdStrings index) { cmdAppend(cmdString(index)); }
+    boolean cmdWrite();
+    opResult cmdSend(unsigned long timeout);
+    opResult simpleCmd(cmdStrings index);
+    opResult setParam(cmdStrings name, cmdStrings value);
+    boolean getParamStart(const char *name, boolean nameInFlash, char *param,
+                          size_t paramLen);
+    opResult getParamReply(const char *name, boolean nameInFlash, char *param,
+                           size_t paramLen);
+    
+    // Classify the line in _lineBuf as a reply to a given kind of command.
+    //  IN_PROGRESS means it isn't a reply we're interested in.
+    enum replyTypes {REPLY_OK, REPLY_OPEN, REPLY_RESET, REPLY_STATUS,
+                     REPLY_GET, REPLY_PING, REPLY_INQUIRY, REPLY_SCAN};
+    opResult parseReply(replyTypes type);
+    void noteLine();
+    void noteLines();
+    opResult openCmd(const char *address, connType &connection);
+#if BC127_ENABLE_ADDRESS_TABLE
+    void addressCmd(cmdStrings command, int timeout);
+    opResult addressWait(replyTypes type, int timeout);
+    opResult addressFound(byte offset);
+#endif
+    
+    // Non-blocking command state. The command goes out with a "\r" in front
+    //  of it, for the same reason knownStart() sends one; the first ERROR we
+    //  get back is the module's answer to that, and is skipped.
+    //  ASYNC_DONE means knownStart() saw it through to the end, and the
+    //  result is waiting in _asyncResult.
+    enum asyncStates {ASYNC_IDLE, ASYNC_SKIP, ASYNC_REPLY, ASYNC_DONE};
+    opResult asyncSend(replyTypes type, unsigned long timeout);
+    byte _asyncState;
+    opResult _asyncResult;
+    byte _asyncTag;
+    byte _asyncReply;
+    unsigned long _asyncStart;
+    unsigned long _asyncTimeout;
+    char _asyncPeer[ADDR_LEN];
+    byte _asyncProfile;
+    
+    // Where parseReply() keeps what it's learned from a STATUS or GET reply
+    //  until the "OK" arrives.
+    opResult _statusResult;
+    const char *_getName;
+    boolean _getNameInFlash;
+    char *_getParam;
+    size_t _getParamLen;
+    
+#if BC127_ENABLE_AUDIO
+    // The cached player state, and what to do to it if the outstanding
+    //  non-blocking command succeeds (NO_MUSIC and -1 mean nothing).
+    enum {NO_MUSIC = 0xFF};
+    void noteMusic(audioCmds command);
+    void noteEvent();
+    signed char _volume;
+    byte _playState;
+    byte _asyncMusic;
+    signed char _asyncVolume;
+#endif
+    
+    void notePeer(const char *address, connType connection);
+    char _lastPeer[ADDR_LEN];
+    byte _lastProfiles;
+    unsigned long _lastHeard;
+    boolean _unanswered;
+    boolean _offline;  // Set by setOffline(); portReadLine() gives up at once.
+    boolean _silenceOffline;
+    boolean _dataMode;
+    
+    void noteBanner();
+    char _firmware[VERSION_LEN];
+    byte _firmwareMajor;
+    byte _firmwareMinor;
+    unsigned long _firmwareBuild;
+    unsigned long _resetStart;
+    unsigned long _bootTime;
+    unsigned long _firstCommand;
+    boolean _awaitingCommand;  // Ready, but no command since.
+};
+
+// If you know the concrete type of the serial port the module is attached to
+//  (HardwareSerial, SoftwareSerial, or a fake port on a host build), use this
+//  instead of plain BC127:
+//    SoftwareSerial swPort(3,2);
+//    BC127Port<SoftwareSerial> BTModu(&swPort);
+//  The port's functions are then called directly instead of through Stream's
+//  virtual functions, which lets the compiler inline the receive loops. The
+//  port type doesn't need to inherit from Stream; it only needs available(),
+//  read(), write(uint8_t) and flush().
+template <class SerialPort>
+class BC127Port : public BC127
+{
+  public:
+    BC127Port(SerialPort *sp) : BC127((Stream*)NULL), _port(sp) {}
+  protected:
+    virtual void portWrite(const char *buffer, size_t length)
+    {
+      // Calling through the qualified name skips the virtual dispatch.
+      for (size_t i = 0; i < length; i++) _port->SerialPort::write((uint8_t)buffer[i]);
+      _port->SerialPort::flush();
+    }
+    virtual boolean portReadLine(unsigned long startTime, unsigned long timeout,
+                                 boolean restartOnData = false)
+    {
+      lineClear();
+      if (offline()) return false;
+      while (millis() - startTime < timeout)
+      {
+        if (_port->SerialPort::available() > 0)
+        {
+          if (restartOnData) startTime = millis();
+          if (lineAppend((char)_port->SerialPort::read())) return true;
+        }
+      }
+      return false;
+    }
+    virtual void portPurge()
+    {
+      while (_port->SerialPort::available() > 0) _port->SerialPort::read();
+    }
+    virtual boolean portPollLine()
+    {
+      while (_port->SerialPort::available() > 0)
+      {
+        if (lineAppend((char)_port->SerialPort::read())) return true;
+      }
+      return false;
+    }
+  private:
+    SerialPort *_port;
 };
 
 
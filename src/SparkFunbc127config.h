@@ -0,0 +1,69 @@
+/****************************************************************
+Feature selection for the BC127 library.
+
+Each of these switches pulls a whole group of functions (and the
+strings and buffers that go with them) into, or out of, the build.
+Set any of them to 0 to strip that group out; calling a function
+from a group that's been stripped out is a compile error, so you'll
+know right away if you took out something you need.
+
+The Arduino IDE doesn't pass #defines from a sketch to the library,
+so the easiest way to change these is to edit this file. If your
+build system lets you add compiler flags (-DBC127_ENABLE_AUDIO=0,
+say), those will override the defaults here. extras/size_report.sh
+shows what each switch saves, in flash and RAM, on your board.
+
+This code is beerware; if you use it, please buy me (or any other
+SparkFun employee) a cold beverage next time you run into one of
+us at the local.
+****************************************************************/
+
+#ifndef BC127config_h
+#define BC127config_h
+
+// Classic Bluetooth discovery: inquiry(). Also keeps the table of found
+//  addresses used by getAddress() and connect(index).
+#ifndef BC127_ENABLE_CLASSIC_DISCOVERY
+#define BC127_ENABLE_CLASSIC_DISCOVERY 1
+#endif
+
+// Bluetooth Low Energy: BLEDisable(), BLECentral(), BLEPeripheral(),
+//  BLEAdvertise(), BLENoAdvertise(), BLEScan(), and connecting with BLE.
+#ifndef BC127_ENABLE_BLE
+#define BC127_ENABLE_BLE 1
+#endif
+
+// Audio: musicCommands(), setClassicSink(), setClassicSource(), and
+//  connecting with A2DP, AVRCP, HFP or PBAP.
+#ifndef BC127_ENABLE_AUDIO
+#define BC127_ENABLE_AUDIO 1
+#endif
+
+// Data mode: enterDataMode() and exitDataMode().
+#ifndef BC127_ENABLE_DATA_MODE
+#define BC127_ENABLE_DATA_MODE 1
+#endif
+
+// How many devices BC127PeerCache remembers. Each one costs 11 bytes of RAM,
+//  and the same again in EEPROM (or whatever you store them in).
+#ifndef BC127_PEER_CACHE_SIZE
+#define BC127_PEER_CACHE_SIZE 4
+#endif
+
+// How many modules a BC127Group can look after, and how many commands each
+//  one can have waiting. Each waiting command costs 13 bytes of RAM (20 on
+//  32-bit boards). The last place in each queue is kept for interactive
+//  commands, so this needs to be at least 2 to queue background commands.
+#ifndef BC127_GROUP_SIZE
+#define BC127_GROUP_SIZE 4
+#endif
+#ifndef BC127_GROUP_QUEUE_LEN
+#define BC127_GROUP_QUEUE_LEN 4
+#endif
+
+// The address table is shared by classic discovery and BLE scanning, so we
+//  only need it if one of those is turned on.
+#define BC127_ENABLE_ADDRESS_TABLE \
+  (BC127_ENABLE_CLASSIC_DISCOVERY || BC127_ENABLE_BLE)
+
+#endif
@@ -0,0 +1,39 @@
+/****************************************************************
+EEPROM storage for the BC127 known-peer cache.
+
+This code is beerware; if you use it, please buy me (or any other
+SparkFun employee) a cold beverage next time you run into one of
+us at the local.
+****************************************************************/
+
+#ifndef BC127eepromstore_h
+#define BC127eepromstore_h
+
+#include <Arduino.h>
+#include <EEPROM.h>
+#include "SparkFunbc127peers.h"
+
+// Keeps the peer list in the on-chip EEPROM, starting at the address you
+//  give it. EEPROM.update() only writes the bytes that have changed, which
+//  spares the EEPROM when the same device keeps reconnecting.
+class BC127EEPROMStore : public BC127PeerStore
+{
+  public:
+    BC127EEPROMStore(int address) : _address(address) {}
+    virtual boolean load(void *data, size_t length)
+    {
+      byte *bytes = (byte *)data;
+      for (size_t i = 0; i < length; i++) bytes[i] = EEPROM.read(_address + i);
+      return true;
+    }
+    virtual boolean save(const void *data, size_t length)
+    {
+      const byte *bytes = (const byte *)data;
+      for (size_t i = 0; i < length; i++) EEPROM.update(_address + i, bytes[i]);
+      return true;
+    }
+  private:
+    int _address;
+};
+
+#endif
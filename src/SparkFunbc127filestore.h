@@ -0,0 +1,42 @@
+/****************************************************************
+File storage for the BC127 known-peer cache, for builds on a host
+(unit tests, simulators) rather than on a board.
+
+This code is beerware; if you use it, please buy me (or any other
+SparkFun employee) a cold beverage next time you run into one of
+us at the local.
+****************************************************************/
+
+#ifndef BC127filestore_h
+#define BC127filestore_h
+
+#include <stdio.h>
+#include "SparkFunbc127peers.h"
+
+// Keeps the peer list in a file. A missing or short file loads as "nothing
+//  stored", just like blank EEPROM would.
+class BC127FileStore : public BC127PeerStore
+{
+  public:
+    BC127FileStore(const char *path) : _path(path) {}
+    virtual boolean load(void *data, size_t length)
+    {
+      FILE *file = fopen(_path, "rb");
+      if (file == NULL) return false;
+      size_t got = fread(data, 1, length, file);
+      fclose(file);
+      return got == length;
+    }
+    virtual boolean save(const void *data, size_t length)
+    {
+      FILE *file = fopen(_path, "wb");
+      if (file == NULL) return false;
+      size_t put = fwrite(data, 1, length, file);
+      fclose(file);
+      return put == length;
+    }
+  private:
+    const char *_path;
+};
+
+#endif
@@ -0,0 +1,369 @@
+/****************************************************************
+Cooperative scheduler for several BC127 modules on one Arduino.
+
+This code is beerware; if you use it, please buy me (or any other
+SparkFun employee) a cold beverage next time you run into one of
+us at the local.
+****************************************************************/
+
+#include "SparkFunbc127group.h"
+#include <Arduino.h>
+
+// Constructor. The group starts out empty; add() the modules to it.
+BC127Group::BC127Group()
+{
+  _count = 0;
+  _next = 0;
+  _done = NULL;
+  for (byte i = 0; i < 2; i++)
+  {
+    _maxDelay[i] = 0;
+    _totalDelay[i] = 0;
+    _started[i] = 0;
+  }
+  _merged = 0;
+}
+
+int BC127Group::add(BC127 *module)
+{
+  if (_count == BC127_GROUP_SIZE) return -1;
+  moduleSlot &slot = _slots[_count];
+  slot.module = module;
+  slot.length = 0;
+  slot.running = false;
+  slot.tag = 0;
+  slot.completed = 0;
+  slot.failed = 0;
+  slot.maxLatency = 0;
+  slot.totalLatency = 0;
+  return _count++;
+}
+
+byte BC127Group::count()
+{
+  return _count;
+}
+
+BC127 *BC127Group::module(byte index)
+{
+  if (index >= _count) return NULL;
+  return _slots[index].module;
+}
+
+void BC127Group::setCallback(void (*done)(byte index, BC127::opResult result))
+{
+  _done = done;
+}
+
+// Put a command in its place in a module's queue: interactive commands go
+//  after any other interactive ones, but ahead of background commands that
+//  are still waiting; background commands go on the end.
+boolean BC127Group::enqueue(byte index, byte type, byte priority, byte arg,
+                            int number, const void *data, char *param)
+{
+  if (index >= _count) return false;
+  moduleSlot &slot = _slots[index];
+  // The one that's running can't be moved, or merged with.
+  byte first = slot.running ? 1 : 0;
+  byte place = slot.length;
+
+  if (priority == BACKGROUND)
+  {
+    for (byte i = first; i < slot.length; i++)
+    {
+      queueEntry &entry = slot.queue[i];
+      if (entry.type == type && entry.arg == arg && entry.number == number &&
+          entry.data == data && entry.param == param)
+      {
+        _merged++;
+        return true;
+      }
+    }
+    if (slot.length >= BC127_GROUP_QUEUE_LEN - 1) return false;
+  }
+  else
+  {
+    if (slot.length == BC127_GROUP_QUEUE_LEN) return false;
+    place = first;
+    while (place < slot.length && slot.queue[place].priority == INTERACTIVE)
+      place++;
+  }
+
+  for (byte i = slot.length; i > place; i--) slot.queue[i] = slot.queue[i - 1];
+  queueEntry &entry = slot.queue[place];
+  entry.type = type;
+  entry.priority = priority;
+  entry.arg = arg;
+  entry.number = number;
+  entry.data = data;
+  entry.param = param;
+  entry.queued = millis();
+  slot.length++;
+  return true;
+}
+
+boolean BC127Group::stdCmd(byte index, const char *command,
+                           priorityClass priority)
+{
+  return enqueue(index, Q_CMD, priority, 0, 0, command);
+}
+
+boolean BC127Group::stdCmd(byte index, const __FlashStringHelper *command,
+                           priorityClass priority)
+{
+  return enqueue(index, Q_CMD_FLASH, priority, 0, 0, command);
+}
+
+boolean BC127Group::stdGetParam(byte index, const char *command, char *param,
+                                size_t paramLen)
+{
+  return enqueue(index, Q_GET, BACKGROUND, 0, paramLen, command, param);
+}
+
+boolean BC127Group::stdGetParam(byte index, const __FlashStringHelper *command,
+                                char *param, size_t paramLen)
+{
+  return enqueue(index, Q_GET_FLASH, BACKGROUND, 0, paramLen, command, param);
+}
+
+boolean BC127Group::connectionState(byte index)
+{
+  return enqueue(index, Q_STATUS, BACKGROUND, 0, 0, NULL);
+}
+
+#if BC127_ENABLE_AUDIO
+boolean BC127Group::musicCommands(byte index, BC127::audioCmds command)
+{
+  return enqueue(index, Q_MUSIC, INTERACTIVE, command, 0, NULL);
+}
+#endif
+
+boolean BC127Group::connect(byte index, const char *address,
+                            BC127::connType connection)
+{
+  return enqueue(index, Q_CONNECT, INTERACTIVE, connection, 0, address);
+}
+
+boolean BC127Group::reset(byte index)
+{
+  return enqueue(index, Q_RESET, INTERACTIVE, 0, 0, NULL);
+}
+
+#if BC127_ENABLE_CLASSIC_DISCOVERY
+boolean BC127Group::inquiry(byte index, int timeout)
+{
+  return enqueue(index, Q_INQUIRY, INTERACTIVE, 0, timeout, NULL);
+}
+#endif
+
+#if BC127_ENABLE_BLE
+boolean BC127Group::BLEScan(byte index, int timeout)
+{
+  return enqueue(index, Q_SCAN, INTERACTIVE, 0, timeout, NULL);
+}
+#endif
+
+// Kick off the command at the head of a module's queue. Anything other than
+//  IN_PROGRESS means it never got going (a bad parameter, say).
+BC127::opResult BC127Group::start(moduleSlot &slot)
+{
+  queueEntry &entry = slot.queue[0];
+
+  unsigned long wait = millis() - entry.queued;
+  _started[entry.priority]++;
+  _totalDelay[entry.priority] += wait;
+  if (wait > _maxDelay[entry.priority]) _maxDelay[entry.priority] = wait;
+
+  switch(entry.type)
+  {
+    case Q_CMD:
+      return slot.module->stdCmdAsync((const char *)entry.data);
+    case Q_CMD_FLASH:
+      return slot.module->stdCmdAsync(
+        (const __FlashStringHelper *)entry.data);
+    case Q_GET:
+      return slot.module->stdGetParamAsync((const char *)entry.data,
+                                           entry.param, entry.number);
+    case Q_GET_FLASH:
+      return slot.module->stdGetParamAsync(
+        (const __FlashStringHelper *)entry.data, entry.param, entry.number);
+    case Q_STATUS:
+      return slot.module->connectionStateAsync();
+#if BC127_ENABLE_AUDIO
+    case Q_MUSIC:
+      return slot.module->musicCommandsAsync((BC127::audioCmds)entry.arg);
+#endif
+    case Q_CONNECT:
+      return slot.module->connectAsync((const char *)entry.data,
+                                       (BC127::connType)entry.arg);
+    case Q_RESET:
+      return slot.module->resetAsync();
+#if BC127_ENABLE_CLASSIC_DISCOVERY
+    case Q_INQUIRY:
+      return slot.module->inquiryAsync(entry.number);
+#endif
+#if BC127_ENABLE_BLE
+    case Q_SCAN:
+      return slot.module->BLEScanAsync(entry.number);
+#endif
+    default:
+      return BC127::INVALID_PARAM;
+  }
+}
+
+// The command at the head of the queue is done. Take it off the queue before
+//  telling anyone, so the callback is free to queue up something else.
+void BC127Group::finish(byte index, BC127::opResult result)
+{
+  moduleSlot &slot = _slots[index];
+  unsigned long latency = millis() - slot.queue[0].queued;
+
+  slot.length--;
+  for (byte i = 0; i < slot.length; i++) slot.queue[i] = slot.queue[i + 1];
+  slot.running = false;
+
+  // Inquiry and scan return a count of devices found, which is a success
+  //  even if it's zero.
+  if (result >= 0) slot.completed++;
+  else slot.failed++;
+  slot.totalLatency += latency;
+  if (latency > slot.maxLatency) slot.maxLatency = latency;
+
+  if (_done != NULL) _done(index, result);
+}
+
+// One pass over every module. None of this waits: asyncPoll() only reads what
+//  has already arrived, and starting a command is just a write. We start the
+//  pass one module further along each time, so when several commands finish
+//  at once, no module always gets its callback first.
+void BC127Group::poll()
+{
+  for (byte n = 0; n < _count; n++)
+  {
+    byte index = (_next + n) % _count;
+    moduleSlot &slot = _slots[index];
+
+    if (slot.running)
+    {
+      // If the module's running somebody else's command, ours is gone.
+      BC127::opResult result = BC127::INVALID_PARAM;
+      if (slot.module->asyncTag() == slot.tag)
+        result = slot.module->asyncPoll();
+      if (result == BC127::IN_PROGRESS) continue;
+      finish(index, result);
+      // Leave the module free until the next pass. Anything else sharing it
+      //  (a BC127Remote with a button press to send, say) only gets a look in
+      //  when it's free, and with a full queue, that would otherwise be never.
+      continue;
+    }
+
+    // Free now; start the next command, if there is one, unless somebody else
+    //  (a BC127Health probe, say) is using the module. If it won't even start,
+    //  report that and move on to the one after.
+    while (slot.length > 0 && !slot.running && !slot.module->asyncBusy())
+    {
+      BC127::opResult result = start(slot);
+      if (result == BC127::IN_PROGRESS)
+      {
+        slot.running = true;
+        slot.tag = slot.module->asyncTag();
+      }
+      else finish(index, result);
+    }
+  }
+  if (_count > 0) _next = (_next + 1) % _count;
+}
+
+byte BC127Group::pending(byte index)
+{
+  if (index >= _count) return 0;
+  return _slots[index].length;
+}
+
+boolean BC127Group::idle()
+{
+  for (byte i = 0; i < _count; i++)
+  {
+    if (_slots[i].length > 0) return false;
+  }
+  return true;
+}
+
+unsigned int BC127Group::completed()
+{
+  unsigned int total = 0;
+  for (byte i = 0; i < _count; i++) total += _slots[i].completed;
+  return total;
+}
+
+unsigned int BC127Group::completed(byte index)
+{
+  if (index >= _count) return 0;
+  return _slots[index].completed;
+}
+
+unsigned int BC127Group::failed()
+{
+  unsigned int total = 0;
+  for (byte i = 0; i < _count; i++) total += _slots[i].failed;
+  return total;
+}
+
+unsigned int BC127Group::failed(byte index)
+{
+  if (index >= _count) return 0;
+  return _slots[index].failed;
+}
+
+unsigned long BC127Group::maxLatency()
+{
+  unsigned long most = 0;
+  for (byte i = 0; i < _count; i++)
+  {
+    if (_slots[i].maxLatency > most) most = _slots[i].maxLatency;
+  }
+  return most;
+}
+
+unsigned long BC127Group::maxLatency(byte index)
+{
+  if (index >= _count) return 0;
+  return _slots[index].maxLatency;
+}
+
+unsigned long BC127Group::averageLatency()
+{
+  unsigned long total = 0;
+  unsigned int commands = 0;
+  for (byte i = 0; i < _count; i++)
+  {
+    total += _slots[i].totalLatency;
+    commands += _slots[i].completed + _slots[i].failed;
+  }
+  if (commands == 0) return 0;
+  return total / commands;
+}
+
+unsigned long BC127Group::averageLatency(byte index)
+{
+  if (index >= _count) return 0;
+  unsigned int commands = _slots[index].completed + _slots[index].failed;
+  if (commands == 0) return 0;
+  return _slots[index].totalLatency / commands;
+}
+
+unsigned long BC127Group::maxQueueDelay(priorityClass priority)
+{
+  return _maxDelay[priority];
+}
+
+unsigned long BC127Group::averageQueueDelay(priorityClass priority)
+{
+  if (_started[priority] == 0) return 0;
+  return _totalDelay[priority] / _started[priority];
+}
+
+unsigned int BC127Group::merged()
+{
+  return _merged;
+}
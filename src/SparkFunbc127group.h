@@ -0,0 +1,162 @@
+/****************************************************************
+Cooperative scheduler for several BC127 modules on one Arduino.
+
+This code is beerware; if you use it, please buy me (or any other
+SparkFun employee) a cold beverage next time you run into one of
+us at the local.
+****************************************************************/
+
+#ifndef BC127group_h
+#define BC127group_h
+
+#include <Arduino.h>
+#include "SparkFunbc127.h"
+
+// The ordinary BC127 functions wait for the module to answer before they
+//  return, which is fine with one module but not with four: while one of
+//  them is running a ten second inquiry(), the others get nothing. This class
+//  looks after a set of modules at once. Each one gets a short queue of
+//  commands; poll() goes round all of them, starting the next command on any
+//  module that's free and checking on the ones that are busy, without ever
+//  waiting on any of them. So one module can scan while the others carry on
+//  with their own work, and your loop() can keep feeding data to any that are
+//  in data mode.
+//
+// Commands are either INTERACTIVE (things a user is waiting on, like a button
+//  press) or BACKGROUND (housekeeping: connectionState() and stdGetParam()
+//  polls). An interactive command goes ahead of any background commands that
+//  haven't started yet, so the most it waits for is the one command that's
+//  already running, plus any interactive commands queued before it. The last
+//  place in each queue is kept for interactive commands, and a background
+//  command that's already waiting isn't queued again; the second request is
+//  merged with the first, so a poller that runs faster than the module can't
+//  pile up stale copies of the same query.
+//
+// You can still call the blocking functions on a module in the group, but if
+//  it has a command running here, they'll wait for that to finish before
+//  sending their own, which can take as long as that command's timeout. The
+//  command's result still comes back through poll() as usual. A BC127Health,
+//  BC127Remote or BC127Reconnect can work on the same module at the same time;
+//  we wait for each other's commands to finish (see BC127::asyncTag()), and
+//  after each of ours, we leave the module free until the next poll(), so
+//  they get their turn however full our queue is. For that to work, call
+//  their update() in the same loop() as poll().
+class BC127Group
+{
+  public:
+    enum priorityClass {INTERACTIVE, BACKGROUND};
+
+    BC127Group();
+
+    // Add a module to the group. Returns its index, which is how you refer to
+    //  it from then on, or -1 if the group is already full (see
+    //  BC127_GROUP_SIZE in SparkFunbc127config.h).
+    int add(BC127 *module);
+    byte count();
+    BC127 *module(byte index);
+
+    // Queue up a command for a module. These return false if the index is bad
+    //  or that module's queue is full. Strings aren't copied, so anything you
+    //  pass in (including the buffer a GET's value goes into) has to stay put
+    //  until the command has run. stdCmd() is interactive unless you say
+    //  otherwise; connectionState() and stdGetParam() are background.
+    boolean stdCmd(byte index, const char *command,
+                   priorityClass priority = INTERACTIVE);
+    boolean stdCmd(byte index, const __FlashStringHelper *command,
+                   priorityClass priority = INTERACTIVE);
+    boolean stdGetParam(byte index, const char *command, char *param,
+                        size_t paramLen);
+    boolean stdGetParam(byte index, const __FlashStringHelper *command,
+                        char *param, size_t paramLen);
+    boolean connectionState(byte index);
+#if BC127_ENABLE_AUDIO
+    boolean musicCommands(byte index, BC127::audioCmds command);
+#endif
+    boolean connect(byte index, const char *address,
+                    BC127::connType connection);
+    boolean reset(byte index);
+#if BC127_ENABLE_CLASSIC_DISCOVERY
+    boolean inquiry(byte index, int timeout);
+#endif
+#if BC127_ENABLE_BLE
+    boolean BLEScan(byte index, int timeout);
+#endif
+
+    // Call this from loop(), as often as you can. Each time a command
+    //  finishes, the callback (if you've set one) is told which module it was
+    //  and how it turned out; that's the same opResult the blocking function
+    //  would have returned.
+    void poll();
+    void setCallback(void (*done)(byte index, BC127::opResult result));
+
+    // How many commands a module has waiting, including the one that's
+    //  running; idle() is true when nothing is waiting anywhere.
+    byte pending(byte index);
+    boolean idle();
+
+    // Statistics, for one module or for the whole group. Latency is in
+    //  milliseconds, from queueing the command to getting its result, so it
+    //  includes time spent waiting behind other commands.
+    unsigned int completed();
+    unsigned int completed(byte index);
+    unsigned int failed();
+    unsigned int failed(byte index);
+    unsigned long maxLatency();
+    unsigned long maxLatency(byte index);
+    unsigned long averageLatency();
+    unsigned long averageLatency(byte index);
+    // How long commands of each class sat in the queue before they were
+    //  started, and how many background commands were merged.
+    unsigned long maxQueueDelay(priorityClass priority);
+    unsigned long averageQueueDelay(priorityClass priority);
+    unsigned int merged();
+
+  private:
+    enum queueTypes {Q_CMD, Q_CMD_FLASH, Q_GET, Q_GET_FLASH, Q_STATUS,
+                     Q_MUSIC, Q_CONNECT, Q_RESET, Q_INQUIRY, Q_SCAN};
+
+    // arg is the connType or audioCmds value; number is the timeout for an
+    //  inquiry or scan, or the length of param for a GET.
+    struct queueEntry
+    {
+      byte type;
+      byte priority;
+      byte arg;
+      int number;
+      const void *data;
+      char *param;
+      unsigned long queued;
+    };
+
+    // The queue is kept in order; queue[0] is the command that's running (or
+    //  will run next).
+    struct moduleSlot
+    {
+      BC127 *module;
+      queueEntry queue[BC127_GROUP_QUEUE_LEN];
+      byte length;
+      boolean running;
+      byte tag;  // The module's asyncTag() for the command that's running.
+      unsigned int completed;
+      unsigned int failed;
+      unsigned long maxLatency;
+      unsigned long totalLatency;
+    };
+
+    boolean enqueue(byte index, byte type, byte priority, byte arg,
+                    int number, const void *data, char *param = NULL);
+    BC127::opResult start(moduleSlot &slot);
+    void finish(byte index, BC127::opResult result);
+
+    moduleSlot _slots[BC127_GROUP_SIZE];
+    byte _count;
+    byte _next;
+    void (*_done)(byte index, BC127::opResult result);
+
+    unsigned long _maxDelay[2];
+    unsigned long _totalDelay[2];
+    unsigned int _started[2];
+    unsigned int _merged;
+};
+
+#endif
@@ -0,0 +1,208 @@
+/****************************************************************
+Liveness monitor for BC127 modules.
+
+This code is beerware; if you use it, please buy me (or any other
+SparkFun employee) a cold beverage next time you run into one of
+us at the local.
+****************************************************************/
+
+#include "SparkFunbc127health.h"
+#include <Arduino.h>
+
+// Constructor. By default, we probe after a second of quiet and give the
+//  module 50ms to answer, which is plenty even at 9600 baud. While it's down,
+//  we probe every quarter second and pull the reset line (if we can) every
+//  eight failed probes. Now that we're here to bring the module back, a
+//  command that can't raise it can take it offline.
+BC127Health::BC127Health(BC127 *module)
+{
+  _module = module;
+  _module->setOfflineOnSilence(true);
+  _resetHook = NULL;
+  _state = HEALTHY;
+  _idleTime = 1000;
+  _timeout = 50;
+  _retryTime = 250;
+  _resetEvery = 8;
+  _probeStart = 0;
+  _probeTag = 0;
+  _downStart = 0;
+  _failedRetries = 0;
+  _probes = 0;
+  _lastProbe = 0;
+  _maxProbe = 0;
+  _outages = 0;
+  _lastDetection = 0;
+  _maxDetection = 0;
+  _lastDowntime = 0;
+  _totalDowntime = 0;
+}
+
+void BC127Health::setProbe(unsigned long idleTime, unsigned long timeout)
+{
+  _idleTime = idleTime;
+  _timeout = timeout;
+}
+
+void BC127Health::setRetry(unsigned long retryTime, byte resetEvery)
+{
+  _retryTime = retryTime;
+  _resetEvery = resetEvery;
+}
+
+void BC127Health::setResetHook(void (*resetHook)(BC127 *module))
+{
+  _resetHook = resetHook;
+}
+
+BC127Health::healthState BC127Health::state()
+{
+  return _state;
+}
+
+void BC127Health::startProbe()
+{
+  _probes++;
+  _probeStart = millis();
+  _module->pingAsync(_timeout);
+  _probeTag = _module->asyncTag();
+}
+
+// Check on our probe. If the module's running some other command now, our
+//  probe is gone, and that's all we can say about it.
+BC127::opResult BC127Health::pollProbe()
+{
+  if (_module->asyncTag() != _probeTag) return BC127::INVALID_PARAM;
+  return _module->asyncPoll();
+}
+
+BC127Health::healthState BC127Health::update()
+{
+  BC127::opResult result;
+
+  switch(_state)
+  {
+    case HEALTHY:
+      // A blocking command has already found out the hard way.
+      if (_module->unanswered())
+      {
+        wentDown();
+        break;
+      }
+      // Someone else's command is running; its reply will tell us all we
+      //  need to know.
+      if (_module->asyncBusy()) break;
+      // In data mode, our probe would go over the air to the other end, and
+      //  nothing would come back.
+      if (_module->dataMode()) break;
+      if (millis() - _module->lastHeard() < _idleTime) break;
+      startProbe();
+      _state = PROBING;
+      break;
+
+    case PROBING:
+      result = pollProbe();
+      if (result == BC127::IN_PROGRESS) break;
+      if (result == BC127::SUCCESS)
+      {
+        unsigned long probeTime = millis() - _probeStart;
+        _lastProbe = probeTime;
+        if (probeTime > _maxProbe) _maxProbe = probeTime;
+        _state = HEALTHY;
+      }
+      // If somebody else's command took the module away from us, it'll find
+      //  out for itself whether the module is there.
+      else if (result == BC127::INVALID_PARAM && !_module->unanswered())
+        _state = HEALTHY;
+      else wentDown();
+      break;
+
+    case DOWN:
+      if (millis() - _probeStart < _retryTime) break;
+      if (_module->asyncBusy()) break;
+      startProbe();
+      _state = RECOVERING;
+      break;
+
+    case RECOVERING:
+      result = pollProbe();
+      if (result == BC127::IN_PROGRESS) break;
+      // Lost our probe; try again next time round, without counting it.
+      if (result == BC127::INVALID_PARAM)
+      {
+        _state = DOWN;
+        break;
+      }
+      if (result == BC127::SUCCESS)
+      {
+        _lastDowntime = millis() - _downStart;
+        _totalDowntime += _lastDowntime;
+        _module->setOffline(false);
+        _state = HEALTHY;
+        break;
+      }
+      _state = DOWN;
+      _failedRetries++;
+      if (_resetHook != NULL && _failedRetries >= _resetEvery)
+      {
+        _failedRetries = 0;
+        _resetHook(_module);
+      }
+      break;
+  }
+  return _state;
+}
+
+// No answer. From here on, commands fail without waiting, until a probe gets
+//  through.
+void BC127Health::wentDown()
+{
+  _downStart = millis();
+  _lastDetection = _downStart - _module->lastHeard();
+  if (_lastDetection > _maxDetection) _maxDetection = _lastDetection;
+  _outages++;
+  _failedRetries = 0;
+  _module->setOffline(true);
+  _state = DOWN;
+  if (_resetHook != NULL) _resetHook(_module);
+}
+
+unsigned int BC127Health::probes()
+{
+  return _probes;
+}
+
+unsigned long BC127Health::lastProbeTime()
+{
+  return _lastProbe;
+}
+
+unsigned long BC127Health::maxProbeTime()
+{
+  return _maxProbe;
+}
+
+unsigned int BC127Health::outages()
+{
+  return _outages;
+}
+
+unsigned long BC127Health::lastDetectionTime()
+{
+  return _lastDetection;
+}
+
+unsigned long BC127Health::maxDetectionTime()
+{
+  return _maxDetection;
+}
+
+unsigned long BC127Health::lastDowntime()
+{
+  return _lastDowntime;
+}
+
+unsigned long BC127Health::totalDowntime()
+{
+  return _totalDowntime;
+}
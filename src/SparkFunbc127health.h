@@ -0,0 +1,98 @@
+/****************************************************************
+Liveness monitor for BC127 modules.
+
+This code is beerware; if you use it, please buy me (or any other
+SparkFun employee) a cold beverage next time you run into one of
+us at the local.
+****************************************************************/
+
+#ifndef BC127health_h
+#define BC127health_h
+
+#include <Arduino.h>
+#include "SparkFunbc127.h"
+
+// A module that has locked up or browned out doesn't say so; we only find
+//  out when a command times out, two to five seconds later, and then every
+//  command after that takes just as long to fail. This class keeps an eye
+//  on the module instead. Whenever it's been quiet for a while, we send it
+//  an empty line, which it answers with "ERROR" in a few milliseconds; if
+//  no answer comes back within the probe timeout, the module is marked
+//  offline (see BC127::setOffline()), and from then on every command fails
+//  straight away instead of waiting. A blocking command that gets no answer
+//  marks it offline too, without waiting for us (see
+//  BC127::setOfflineOnSilence()). We keep probing, and as soon as the module
+//  answers again, it's back online.
+//
+// If you have the module's reset line wired to a pin, give us a function
+//  that pulses it, and we'll call it when the module goes down, and again
+//  every so often if it stays down.
+//
+// Nothing here blocks: call update() from loop(). Any reply the module sends
+//  counts as a sign of life, so a busy module never gets probed. We only send
+//  a probe when nobody else has a non-blocking command running, and only ever
+//  collect the result of our own probe (see BC127::asyncTag()), so a
+//  BC127Group, BC127Remote or BC127Reconnect can share the module with us.
+//  While the module is in data mode (see BC127::dataMode()), we don't probe
+//  at all.
+class BC127Health
+{
+  public:
+    enum healthState {HEALTHY, PROBING, DOWN, RECOVERING};
+
+    BC127Health(BC127 *module);
+
+    healthState update();
+    healthState state();
+
+    // Tuning. A probe goes out after idleTime ms with nothing heard from the
+    //  module, and fails if no answer comes back within timeout ms. While the
+    //  module is down, we probe every retryTime ms, and call the reset hook
+    //  (if any) after every resetEvery failed probes.
+    void setProbe(unsigned long idleTime, unsigned long timeout);
+    void setRetry(unsigned long retryTime, byte resetEvery);
+    void setResetHook(void (*resetHook)(BC127 *module));
+
+    // Statistics, in milliseconds. Detection time is from the last time we
+    //  heard from the module to the moment we marked it offline; downtime is
+    //  from then until it answered again.
+    unsigned int probes();
+    unsigned long lastProbeTime();
+    unsigned long maxProbeTime();
+    unsigned int outages();
+    unsigned long lastDetectionTime();
+    unsigned long maxDetectionTime();
+    unsigned long lastDowntime();
+    unsigned long totalDowntime();
+
+  private:
+    BC127Health();
+    void startProbe();
+    BC127::opResult pollProbe();
+    void wentDown();
+
+    BC127 *_module;
+    void (*_resetHook)(BC127 *module);
+    healthState _state;
+
+    unsigned long _idleTime;
+    unsigned long _timeout;
+    unsigned long _retryTime;
+    byte _resetEvery;
+
+    unsigned long _probeStart;
+    byte _probeTag;
+    unsigned long _downStart;
+    byte _failedRetries;
+
+    unsigned int _probes;
+    unsigned long _lastProbe;
+    unsigned long _maxProbe;
+    unsigned int _outages;
+    unsigned long _lastDetection;
+    unsigned long _maxDetection;
+    unsigned long _lastDowntime;
+    unsigned long _totalDowntime;
+};
+
+#endif
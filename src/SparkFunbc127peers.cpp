@@ -0,0 +1,250 @@
+/****************************************************************
+Known-peer cache for BC127 modules.
+
+This code is beerware; if you use it, please buy me (or any other
+SparkFun employee) a cold beverage next time you run into one of
+us at the local.
+****************************************************************/
+
+#include "SparkFunbc127peers.h"
+#include <Arduino.h>
+#include <stddef.h>
+
+// Marks a block of storage as ours. Change it if the layout of cacheImage
+//  ever changes, so an old list isn't misread.
+#define PEER_CACHE_MAGIC 0xB1
+
+// Addresses come from the module as 12 upper case hex digits; we keep them
+//  as 6 bytes. These convert between the two.
+static boolean addressToBytes(const char *address, byte *bytes)
+{
+  if (strlen(address) != 12) return false;
+  for (byte i = 0; i < 12; i++)
+  {
+    char c = address[i];
+    byte nibble;
+    if (c >= '0' && c <= '9') nibble = c - '0';
+    else if (c >= 'A' && c <= 'F') nibble = c - 'A' + 10;
+    else if (c >= 'a' && c <= 'f') nibble = c - 'a' + 10;
+    else return false;
+    if (i % 2 == 0) bytes[i/2] = nibble << 4;
+    else bytes[i/2] |= nibble;
+  }
+  return true;
+}
+
+static void bytesToAddress(const byte *bytes, char *address)
+{
+  static const char hexDigits[] PROGMEM = "0123456789ABCDEF";
+  for (byte i = 0; i < 6; i++)
+  {
+    address[i*2] = pgm_read_byte(&hexDigits[bytes[i] >> 4]);
+    address[i*2 + 1] = pgm_read_byte(&hexDigits[bytes[i] & 0x0F]);
+  }
+  address[12] = '\0';
+}
+
+// Constructor. Nothing is loaded until begin().
+BC127PeerCache::BC127PeerCache(BC127 *module, BC127PeerStore *store)
+{
+  _module = module;
+  _store = store;
+  _clock = millis;
+  _image.magic = PEER_CACHE_MAGIC;
+  _image.count = 0;
+  _image.checksum = checksum();
+}
+
+void BC127PeerCache::setClock(unsigned long (*clock)())
+{
+  _clock = clock;
+}
+
+// Pull the list in from the store, and make sure it's something we wrote.
+//  Blank EEPROM, a list from a build with a different cache size, or a
+//  half-finished write all fail one of these checks.
+boolean BC127PeerCache::begin()
+{
+  if (_store->load(&_image, sizeof(_image)) &&
+      _image.magic == PEER_CACHE_MAGIC &&
+      _image.count <= BC127_PEER_CACHE_SIZE &&
+      _image.checksum == checksum())
+  {
+    return true;
+  }
+  _image.magic = PEER_CACHE_MAGIC;
+  _image.count = 0;
+  _image.checksum = checksum();
+  return false;
+}
+
+// A simple rotate-and-XOR over everything but the checksum itself.
+byte BC127PeerCache::checksum()
+{
+  const byte *data = (const byte *)&_image;
+  byte sum = 0;
+  for (size_t i = 0; i < offsetof(cacheImage, checksum); i++)
+    sum = (sum << 1 | sum >> 7) ^ data[i];
+  return sum;
+}
+
+void BC127PeerCache::save()
+{
+  _image.checksum = checksum();
+  _store->save(&_image, sizeof(_image));
+}
+
+int BC127PeerCache::find(const byte *address)
+{
+  for (byte i = 0; i < _image.count; i++)
+  {
+    if (memcmp(_image.peers[i].address, address, 6) == 0) return i;
+  }
+  return -1;
+}
+
+void BC127PeerCache::removeAt(byte index)
+{
+  for (byte i = index; i + 1 < _image.count; i++)
+    _image.peers[i] = _image.peers[i + 1];
+  _image.count--;
+}
+
+// Put this device at the front of the list. If it was already in the list,
+//  it moves up; if not, and the list is full, the least recently used device
+//  falls off the end.
+BC127::opResult BC127PeerCache::remember(const char *address, byte profiles)
+{
+  peerRecord record;
+  if (!addressToBytes(address, record.address)) return BC127::INVALID_PARAM;
+  record.profiles = profiles;
+  record.lastSuccess = _clock();
+
+  int index = find(record.address);
+  if (index >= 0) removeAt(index);
+  else if (_image.count == BC127_PEER_CACHE_SIZE) _image.count--;
+
+  for (byte i = _image.count; i > 0; i--) _image.peers[i] = _image.peers[i - 1];
+  _image.peers[0] = record;
+  _image.count++;
+  save();
+  return BC127::SUCCESS;
+}
+
+BC127::opResult BC127PeerCache::rememberLast()
+{
+  if (_module->lastProfiles() == 0) return BC127::INVALID_PARAM;
+  return remember(_module->lastPeer(), _module->lastProfiles());
+}
+
+void BC127PeerCache::forget(const char *address)
+{
+  byte bytes[6];
+  if (!addressToBytes(address, bytes)) return;
+  int index = find(bytes);
+  if (index < 0) return;
+  removeAt(index);
+  save();
+}
+
+void BC127PeerCache::clear()
+{
+  _image.count = 0;
+  save();
+}
+
+byte BC127PeerCache::count()
+{
+  return _image.count;
+}
+
+BC127::opResult BC127PeerCache::getPeer(byte index, char *address,
+                                        byte *profiles,
+                                        unsigned long *lastSuccess)
+{
+  if (index >= _image.count)
+  {
+    address[0] = '\0';
+    return BC127::INVALID_PARAM;
+  }
+  bytesToAddress(_image.peers[index].address, address);
+  if (profiles != NULL) *profiles = _image.peers[index].profiles;
+  if (lastSuccess != NULL) *lastSuccess = _image.peers[index].lastSuccess;
+  return BC127::SUCCESS;
+}
+
+// Open each profile in the mask, lowest connType first. The first one tells
+//  us whether the device is there at all; if it is, a failure on a later
+//  profile isn't enough to give up on it.
+BC127::opResult BC127PeerCache::openProfiles(const char *address, byte profiles)
+{
+  BC127::opResult result = BC127::CONNECT_ERROR;
+  boolean first = true;
+  for (byte profile = BC127::SPP; profile <= BC127::PBAP; profile++)
+  {
+    if ((profiles & (1 << profile)) == 0) continue;
+    BC127::opResult thisResult = _module->connect(address,
+                                                  (BC127::connType)profile);
+    if (first)
+    {
+      if (thisResult != BC127::SUCCESS) return thisResult;
+      result = thisResult;
+      first = false;
+    }
+  }
+  return result;
+}
+
+BC127::opResult BC127PeerCache::connectKnown()
+{
+  char address[BC127::ADDR_LEN];
+  for (byte i = 0; i < _image.count; i++)
+  {
+    bytesToAddress(_image.peers[i].address, address);
+    if (openProfiles(address, _image.peers[i].profiles) == BC127::SUCCESS)
+    {
+      rememberLast();
+      return BC127::SUCCESS;
+    }
+  }
+  return BC127::CONNECT_ERROR;
+}
+
+#if BC127_ENABLE_ADDRESS_TABLE
+// Only if the devices we know about have all let us down do we pay for an
+//  inquiry or a scan. Anything we manage to connect to gets remembered for
+//  next time.
+BC127::opResult BC127PeerCache::connectOrDiscover(int timeout,
+                                                  BC127::connType connection)
+{
+#if !BC127_ENABLE_BLE
+  if (connection == BC127::BLE) return BC127::INVALID_PARAM;
+#endif
+#if !BC127_ENABLE_CLASSIC_DISCOVERY
+  if (connection != BC127::BLE) return BC127::INVALID_PARAM;
+#endif
+
+  if (connectKnown() == BC127::SUCCESS) return BC127::SUCCESS;
+
+  BC127::opResult found = BC127::CONNECT_ERROR;
+#if BC127_ENABLE_BLE
+  if (connection == BC127::BLE) found = _module->BLEScan(timeout);
+#endif
+#if BC127_ENABLE_CLASSIC_DISCOVERY
+  if (connection != BC127::BLE) found = _module->inquiry(timeout);
+#endif
+  if (found <= 0) return BC127::CONNECT_ERROR;
+
+  char address[BC127::ADDR_LEN];
+  for (char i = 0; i < (char)found; i++)
+  {
+    if (_module->getAddress(i, address) != BC127::SUCCESS) continue;
+    if (_module->connect(address, connection) == BC127::SUCCESS)
+    {
+      rememberLast();
+      return BC127::SUCCESS;
+    }
+  }
+  return BC127::CONNECT_ERROR;
+}
+#endif
@@ -0,0 +1,103 @@
+/****************************************************************
+Known-peer cache for BC127 modules.
+
+This code is beerware; if you use it, please buy me (or any other
+SparkFun employee) a cold beverage next time you run into one of
+us at the local.
+****************************************************************/
+
+#ifndef BC127peers_h
+#define BC127peers_h
+
+#include <Arduino.h>
+#include "SparkFunbc127.h"
+
+// Somewhere to keep the peer list between power cycles. The cache hands
+//  over one block of bytes to save, and asks for the same block back at
+//  startup; where it goes is up to you. See SparkFunbc127eepromstore.h for
+//  the on-chip EEPROM, and SparkFunbc127filestore.h for a file on a host.
+class BC127PeerStore
+{
+  public:
+    virtual ~BC127PeerStore() {}
+    virtual boolean load(void *data, size_t length) = 0;
+    virtual boolean save(const void *data, size_t length) = 0;
+};
+
+// Finding a device to connect to normally means an inquiry() or BLEScan(),
+//  which can take ten seconds or more. A unit that talks to the same device
+//  every time it powers up can skip that: this class remembers the devices
+//  we've connected to, which profiles we used, and when, and tries them
+//  most-recently-used first with a direct OPEN.
+//
+// Addresses are kept as 6 bytes rather than 12 characters, so each entry
+//  takes 11 bytes. Timestamps come from millis() unless you supply a clock
+//  of your own (an RTC, say) with setClock().
+class BC127PeerCache
+{
+  public:
+    BC127PeerCache(BC127 *module, BC127PeerStore *store);
+
+    // Load the list from the store. If there's nothing valid there, we
+    //  start with an empty list and return false.
+    boolean begin();
+
+    // Record a successful connection, moving that device to the front of the
+    //  list. rememberLast() uses the module's lastPeer()/lastProfiles().
+    //  Either one saves the list to the store.
+    BC127::opResult remember(const char *address, byte profiles);
+    BC127::opResult rememberLast();
+    void forget(const char *address);
+    void clear();
+
+    // Look at what's in the list, most recent first. address must have room
+    //  for BC127::ADDR_LEN characters.
+    byte count();
+    BC127::opResult getPeer(byte index, char *address, byte *profiles = NULL,
+                            unsigned long *lastSuccess = NULL);
+
+    // Try each known device in turn, opening every profile we used with it
+    //  last time. Returns SUCCESS as soon as one of them answers, or
+    //  CONNECT_ERROR if none does.
+    BC127::opResult connectKnown();
+#if BC127_ENABLE_ADDRESS_TABLE
+    // As above, but if none of the known devices answers, look for new ones
+    //  and try whatever turns up, with the given profile: a BLEScan() for BLE,
+    //  an inquiry() for anything else. Asking for a kind of search that's been
+    //  compiled out gets INVALID_PARAM, before anything is sent.
+    BC127::opResult connectOrDiscover(int timeout, BC127::connType connection);
+#endif
+
+    void setClock(unsigned long (*clock)());
+
+  private:
+    BC127PeerCache();
+
+    struct peerRecord
+    {
+      byte address[6];
+      byte profiles;
+      unsigned long lastSuccess;
+    };
+    // This is exactly what goes to the store.
+    struct cacheImage
+    {
+      byte magic;
+      byte count;
+      peerRecord peers[BC127_PEER_CACHE_SIZE];
+      byte checksum;
+    };
+
+    byte checksum();
+    void save();
+    int find(const byte *address);
+    void removeAt(byte index);
+    BC127::opResult openProfiles(const char *address, byte profiles);
+
+    BC127 *_module;
+    BC127PeerStore *_store;
+    unsigned long (*_clock)();
+    cacheImage _image;
+};
+
+#endif
@@ -0,0 +1,252 @@
+/****************************************************************
+Link-loss reconnect manager for BC127 modules.
+
+This code is beerware; if you use it, please buy me (or any other
+SparkFun employee) a cold beverage next time you run into one of
+us at the local.
+****************************************************************/
+
+#include "SparkFunbc127reconnect.h"
+#include <Arduino.h>
+
+// Constructor. The defaults retry after about a quarter second at first,
+//  backing off to about 30 seconds between attempts; reset the module after
+//  three failed OPENs in a row, and reconfigure it after two resets.
+BC127Reconnect::BC127Reconnect(BC127 *module)
+{
+  _module = module;
+  _reconfigure = NULL;
+  _state = IDLE;
+  _minDelay = 250;
+  _maxDelay = 30000;
+  _opensBeforeReset = 3;
+  _resetsBeforeReconfigure = 2;
+  _failures = 0;
+  _resetCount = 0;
+  _backoffStep = 0;
+  _profilesLeft = 0;
+  _lostTime = 0;
+  _waitStart = 0;
+  _waitDelay = 0;
+  _tag = 0;
+  _recoveries = 0;
+  _attempts = 0;
+  _resets = 0;
+  _reconfigures = 0;
+  _lastRecovery = 0;
+  _maxRecovery = 0;
+  _totalRecovery = 0;
+}
+
+void BC127Reconnect::setBackoff(unsigned long minDelay, unsigned long maxDelay)
+{
+  _minDelay = minDelay;
+  _maxDelay = maxDelay;
+}
+
+void BC127Reconnect::setEscalation(byte opensBeforeReset,
+                                   byte resetsBeforeReconfigure)
+{
+  _opensBeforeReset = opensBeforeReset;
+  _resetsBeforeReconfigure = resetsBeforeReconfigure;
+}
+
+void BC127Reconnect::setReconfigure(void (*reconfigure)(BC127 *module))
+{
+  _reconfigure = reconfigure;
+}
+
+// Start the recovery process. The first attempt is made on the very next
+//  update(), with no reconfiguration at all. If we've never been connected to
+//  anything, there's nothing to go back to, so we stay idle.
+void BC127Reconnect::linkLost()
+{
+  if (_state != IDLE && _state != CONNECTED) return;
+  if (_module->lastProfiles() == 0) return;
+
+  _lostTime = millis();
+  _failures = 0;
+  _resetCount = 0;
+  _backoffStep = 0;
+  _waitStart = _lostTime;
+  _waitDelay = 0;
+  _state = WAITING;
+}
+
+BC127Reconnect::reconnectState BC127Reconnect::state()
+{
+  return _state;
+}
+
+// The state machine. Each pass either checks a timer or checks on the
+//  module's outstanding command, so it never holds up the caller.
+BC127Reconnect::reconnectState BC127Reconnect::update()
+{
+  BC127::opResult result;
+
+  switch(_state)
+  {
+    case WAITING:
+      // Let whatever else is using the module finish first.
+      if (_module->asyncBusy()) break;
+      if (millis() - _waitStart >= _waitDelay) startAttempt();
+      break;
+
+    case RESETTING:
+      result = pollCommand();
+      if (result == BC127::IN_PROGRESS) break;
+      // If the module didn't come back from the reset, that counts as a
+      //  failed attempt; otherwise, go straight on to opening.
+      if (result != BC127::SUCCESS) scheduleRetry();
+      else
+      {
+        _profilesLeft = _module->lastProfiles();
+        if (openNextProfile() != BC127::IN_PROGRESS) scheduleRetry();
+      }
+      break;
+
+    case OPENING:
+      result = pollCommand();
+      if (result == BC127::IN_PROGRESS) break;
+      if (result != BC127::SUCCESS)
+      {
+        scheduleRetry();
+        break;
+      }
+      // That profile's open; on to the next one. If it won't even start, the
+      //  attempt has failed. If there are no more, we're done, and can record
+      //  how long it took.
+      result = openNextProfile();
+      if (result == BC127::IN_PROGRESS) break;
+      if (result != BC127::SUCCESS) scheduleRetry();
+      else
+      {
+        unsigned long recoveryTime = millis() - _lostTime;
+        _recoveries++;
+        _lastRecovery = recoveryTime;
+        _totalRecovery += recoveryTime;
+        if (recoveryTime > _maxRecovery) _maxRecovery = recoveryTime;
+        _state = CONNECTED;
+      }
+      break;
+
+    case IDLE:
+    case CONNECTED:
+    default:
+      break;
+  }
+  return _state;
+}
+
+// Decide how hard to try this time. Usually it's just a matter of opening the
+//  profiles again; if that has failed too often, reset the module first, and
+//  if *that* has failed too often, reconfigure it.
+void BC127Reconnect::startAttempt()
+{
+  _attempts++;
+
+  if (_failures >= _opensBeforeReset)
+  {
+    _failures = 0;
+    if (_reconfigure != NULL && _resetCount >= _resetsBeforeReconfigure)
+    {
+      // This one's up to the user, and will probably block for a while.
+      _resetCount = 0;
+      _reconfigures++;
+      _reconfigure(_module);
+    }
+    else
+    {
+      _resetCount++;
+      _resets++;
+      _module->resetAsync();
+      _tag = _module->asyncTag();
+      _state = RESETTING;
+      return;
+    }
+  }
+
+  _profilesLeft = _module->lastProfiles();
+  if (openNextProfile() != BC127::IN_PROGRESS) scheduleRetry();
+}
+
+// Start opening the next profile on the list, lowest connType first, so A2DP
+//  goes ahead of AVRCP. Returns IN_PROGRESS if it's on its way, SUCCESS when
+//  there's nothing left to open, or whatever connectAsync() said if it
+//  wouldn't start (TIMEOUT_ERROR if the module's offline, for instance).
+BC127::opResult BC127Reconnect::openNextProfile()
+{
+  for (byte profile = BC127::SPP; profile <= BC127::PBAP; profile++)
+  {
+    if ((_profilesLeft & (1 << profile)) == 0) continue;
+    _profilesLeft &= ~(1 << profile);
+    BC127::opResult result =
+      _module->connectAsync(_module->lastPeer(), (BC127::connType)profile);
+    if (result != BC127::IN_PROGRESS) return result;
+    _tag = _module->asyncTag();
+    _state = OPENING;
+    return result;
+  }
+  return BC127::SUCCESS;
+}
+
+// Check on the command we started. If the module's running some other
+//  command now, ours is gone, and the attempt has failed.
+BC127::opResult BC127Reconnect::pollCommand()
+{
+  if (_module->asyncTag() != _tag) return BC127::INVALID_PARAM;
+  return _module->asyncPoll();
+}
+
+// Wait a while before trying again. The delay doubles with each failure, up
+//  to the maximum, and is randomized so that several devices which lost
+//  their links at the same moment don't all retry in lockstep.
+void BC127Reconnect::scheduleRetry()
+{
+  _failures++;
+
+  unsigned long delayCap = _minDelay;
+  for (byte i = 0; i < _backoffStep && delayCap < _maxDelay; i++) delayCap *= 2;
+  if (delayCap > _maxDelay) delayCap = _maxDelay;
+  if (_backoffStep < 255) _backoffStep++;
+
+  _waitDelay = delayCap/2 + random(delayCap/2 + 1);
+  _waitStart = millis();
+  _state = WAITING;
+}
+
+unsigned int BC127Reconnect::recoveries()
+{
+  return _recoveries;
+}
+
+unsigned long BC127Reconnect::lastRecoveryTime()
+{
+  return _lastRecovery;
+}
+
+unsigned long BC127Reconnect::maxRecoveryTime()
+{
+  return _maxRecovery;
+}
+
+unsigned long BC127Reconnect::averageRecoveryTime()
+{
+  if (_recoveries == 0) return 0;
+  return _totalRecovery / _recoveries;
+}
+
+unsigned int BC127Reconnect::attempts()
+{
+  return _attempts;
+}
+
+unsigned int BC127Reconnect::resets()
+{
+  return _resets;
+}
+
+unsigned int BC127Reconnect::reconfigures()
+{
+  return _reconfigures;
+}
@@ -0,0 +1,97 @@
+/****************************************************************
+Link-loss reconnect manager for BC127 modules.
+
+This code is beerware; if you use it, please buy me (or any other
+SparkFun employee) a cold beverage next time you run into one of
+us at the local.
+****************************************************************/
+
+#ifndef BC127reconnect_h
+#define BC127reconnect_h
+
+#include <Arduino.h>
+#include "SparkFunbc127.h"
+
+// When a connection drops, the quickest way back is usually to just ask the
+//  module to OPEN the same device again; a restore/configure/write/reset
+//  cycle costs several seconds and a flash write. This class tries that
+//  first, and only falls back to resetting the module (and then, if you give
+//  it a way to do so, reconfiguring it from scratch) after repeated failures.
+//  Attempts are spaced out with a randomized, growing delay so we don't
+//  hammer a remote device that's out of range.
+//
+// Nothing here blocks: call update() from loop() and it'll do a little work
+//  and return. It reconnects to whatever the module last connected to (see
+//  BC127::lastPeer()), with every profile that was open at the time. Before
+//  each attempt we wait for any other non-blocking command on the module to
+//  finish, so a BC127Group, BC127Health or BC127Remote can share it with us.
+class BC127Reconnect
+{
+  public:
+    enum reconnectState {IDLE, CONNECTED, WAITING, OPENING, RESETTING};
+
+    BC127Reconnect(BC127 *module);
+
+    // Call this when you find out the link is down (for instance, when
+    //  connectionState() returns CONNECT_ERROR). Does nothing if we're already
+    //  working on it.
+    void linkLost();
+    // Call this from loop(). Returns the current state.
+    reconnectState update();
+    reconnectState state();
+
+    // Tuning. The delay before attempt n is somewhere between half and all of
+    //  minDelay * 2^n, capped at maxDelay. After opensBeforeReset failed
+    //  attempts in a row, the module is reset; after resetsBeforeReconfigure
+    //  resets, the reconfigure function (if any) is called instead. That
+    //  function is yours to write, and will usually do what the AudioBridge
+    //  examples do: restore(), set the role, writeConfig() and reset().
+    void setBackoff(unsigned long minDelay, unsigned long maxDelay);
+    void setEscalation(byte opensBeforeReset, byte resetsBeforeReconfigure);
+    void setReconfigure(void (*reconfigure)(BC127 *module));
+
+    // Statistics. Times are in milliseconds, from linkLost() until every
+    //  profile was open again.
+    unsigned int recoveries();
+    unsigned long lastRecoveryTime();
+    unsigned long maxRecoveryTime();
+    unsigned long averageRecoveryTime();
+    unsigned int attempts();
+    unsigned int resets();
+    unsigned int reconfigures();
+
+  private:
+    BC127Reconnect();
+    void scheduleRetry();
+    void startAttempt();
+    BC127::opResult openNextProfile();
+    BC127::opResult pollCommand();
+
+    BC127 *_module;
+    void (*_reconfigure)(BC127 *module);
+    reconnectState _state;
+
+    unsigned long _minDelay;
+    unsigned long _maxDelay;
+    byte _opensBeforeReset;
+    byte _resetsBeforeReconfigure;
+
+    byte _failures;        // Failed attempts since the last escalation.
+    byte _resetCount;      // Resets since the last reconfigure.
+    byte _backoffStep;     // Failed attempts since the link was lost.
+    byte _profilesLeft;    // Profiles still to open on this attempt.
+    unsigned long _lostTime;
+    unsigned long _waitStart;
+    unsigned long _waitDelay;
+    byte _tag;             // asyncTag() of the command we're waiting on.
+
+    unsigned int _recoveries;
+    unsigned int _attempts;
+    unsigned int _resets;
+    unsigned int _reconfigures;
+    unsigned long _lastRecovery;
+    unsigned long _maxRecovery;
+    unsigned long _totalRecovery;
+};
+
+#endif
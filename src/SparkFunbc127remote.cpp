@@ -0,0 +1,146 @@
+/****************************************************************
+Coalescing AVRCP remote control for BC127 modules.
+
+This code is beerware; if you use it, please buy me (or any other
+SparkFun employee) a cold beverage next time you run into one of
+us at the local.
+****************************************************************/
+
+#include "SparkFunbc127remote.h"
+#include <Arduino.h>
+
+#if BC127_ENABLE_AUDIO
+#define NO_TRANSPORT 0xFF
+
+BC127Remote::BC127Remote(BC127 *module)
+{
+  _module = module;
+  _window = 100;
+  _windowStart = 0;
+  _volumeSteps = 0;
+  _trackSteps = 0;
+  _transport = NO_TRANSPORT;
+  _waiting = false;
+  _tag = 0;
+  _presses = 0;
+  _sent = 0;
+}
+
+void BC127Remote::setWindow(unsigned long window)
+{
+  _window = window;
+}
+
+// Note the press, and leave sending it to update(). The window starts with
+//  the first press that finds nothing else waiting.
+void BC127Remote::press(BC127::audioCmds command)
+{
+  _presses++;
+  if (_volumeSteps == 0 && _trackSteps == 0) _windowStart = millis();
+
+  switch(command)
+  {
+    case BC127::UP:
+      if (_volumeSteps < BC127::VOLUME_MAX) _volumeSteps++;
+      break;
+    case BC127::DOWN:
+      if (_volumeSteps > -BC127::VOLUME_MAX) _volumeSteps--;
+      break;
+    case BC127::FORWARD:
+      _trackSteps++;
+      break;
+    case BC127::BACK:
+      _trackSteps--;
+      break;
+    default:
+      _transport = command;
+      break;
+  }
+}
+
+void BC127Remote::update()
+{
+  if (_waiting)
+  {
+    // If the module's running some other command now, ours is gone.
+    if (_module->asyncTag() == _tag &&
+        _module->asyncPoll() == BC127::IN_PROGRESS) return;
+    _waiting = false;
+  }
+  // Somebody else's command is running; leave it be.
+  if (_module->asyncBusy()) return;
+  _module->checkEvents();
+
+  BC127::opResult result = sendNext();
+  if (result == BC127::SUCCESS) return;  // Nothing to send.
+  _sent++;
+  _waiting = (result == BC127::IN_PROGRESS);
+  _tag = _module->asyncTag();
+}
+
+// Start whatever should go next. Returns SUCCESS if there's nothing to do
+//  yet, otherwise whatever the module's non-blocking function returned.
+BC127::opResult BC127Remote::sendNext()
+{
+  if (_transport != NO_TRANSPORT)
+  {
+    BC127::audioCmds command = (BC127::audioCmds)_transport;
+    _transport = NO_TRANSPORT;
+    return _module->musicCommandsAsync(command);
+  }
+
+  if (_volumeSteps == 0 && _trackSteps == 0) return BC127::SUCCESS;
+  if (millis() - _windowStart < _window) return BC127::SUCCESS;
+
+  if (_volumeSteps != 0)
+  {
+    int level = _module->volume();
+    if (level >= 0)
+    {
+      level += _volumeSteps;
+      _volumeSteps = 0;
+      if (level < 0) level = 0;
+      if (level > BC127::VOLUME_MAX) level = BC127::VOLUME_MAX;
+      if (level != _module->volume()) return _module->setVolumeAsync(level);
+    }
+    else if (_volumeSteps > 0)
+    {
+      _volumeSteps--;
+      return _module->musicCommandsAsync(BC127::UP);
+    }
+    else
+    {
+      _volumeSteps++;
+      return _module->musicCommandsAsync(BC127::DOWN);
+    }
+  }
+
+  if (_trackSteps > 0)
+  {
+    _trackSteps--;
+    return _module->musicCommandsAsync(BC127::FORWARD);
+  }
+  if (_trackSteps < 0)
+  {
+    _trackSteps++;
+    return _module->musicCommandsAsync(BC127::BACK);
+  }
+  return BC127::SUCCESS;
+}
+
+boolean BC127Remote::idle()
+{
+  return !_waiting && _transport == NO_TRANSPORT && _volumeSteps == 0 &&
+         _trackSteps == 0;
+}
+
+unsigned int BC127Remote::presses()
+{
+  return _presses;
+}
+
+unsigned int BC127Remote::commandsSent()
+{
+  return _sent;
+}
+#endif
@@ -0,0 +1,66 @@
+/****************************************************************
+Coalescing AVRCP remote control for BC127 modules.
+
+This code is beerware; if you use it, please buy me (or any other
+SparkFun employee) a cold beverage next time you run into one of
+us at the local.
+****************************************************************/
+
+#ifndef BC127remote_h
+#define BC127remote_h
+
+#include <Arduino.h>
+#include "SparkFunbc127.h"
+
+#if BC127_ENABLE_AUDIO
+// Hooking an encoder or a pair of buttons straight to musicCommands() means
+//  one full command per click, each waiting for its reply; spinning the
+//  volume from nothing to full takes fifteen of them. This class takes the
+//  clicks as they come, without waiting, and adds them up. Once the window
+//  (100ms by default) has passed since the first click, it sends the net
+//  result: a single setVolume() to the level all those UPs and DOWNs add up
+//  to, and only as many track skips as are left once FORWARDs and BACKs
+//  cancel out. PLAY, PAUSE and STOP go out right away; if several arrive
+//  while a command is running, only the last one is sent.
+//
+// If we don't know the volume yet (see BC127::volume()), there's nothing to
+//  add the steps to, so they're sent as UP or DOWN one at a time, as before.
+//
+// Nothing here blocks: call update() from loop(). We only send when nobody
+//  else has a non-blocking command running on the module, and only collect
+//  our own results (see BC127::asyncTag()), so a BC127Group, BC127Health or
+//  BC127Reconnect can share the module with us.
+class BC127Remote
+{
+  public:
+    BC127Remote(BC127 *module);
+
+    void press(BC127::audioCmds command);
+    void update();
+    boolean idle();
+    void setWindow(unsigned long window);
+
+    // How many presses we've been given, and how many commands that turned
+    //  into.
+    unsigned int presses();
+    unsigned int commandsSent();
+
+  private:
+    BC127Remote();
+    BC127::opResult sendNext();
+
+    BC127 *_module;
+    unsigned long _window;
+    unsigned long _windowStart;
+    int _volumeSteps;
+    int _trackSteps;
+    byte _transport;   // PLAY, PAUSE or STOP waiting to go out, if any.
+    boolean _waiting;  // We have a command running on the module,
+    byte _tag;         //  and this is its asyncTag().
+
+    unsigned int _presses;
+    unsigned int _sent;
+};
+#endif
+
+#endif
@@ -13,150 +13,213 @@ Code developed in Arduino 1.0.5, on an Arduino Pro Mini 5V.
 #include "SparkFunbc127.h"
 #include <Arduino.h>
 
+#if BC127_ENABLE_ADDRESS_TABLE || BC127_ENABLE_AUDIO
+// Render a (non-negative) integer into the buffer provided, for commands that
+//  take a numeric argument. Returns the buffer, to make it easy to pass along.
+static const char *intToStr(int value, char *buffer)
+{
+  char temp[6];
+  byte i = 0;
+  if (value < 0) value = 0;
+  do
+  {
+    temp[i++] = '0' + (value % 10);
+    value /= 10;
+  } while (value > 0 && i < sizeof(temp));
+  byte j = 0;
+  while (i > 0) buffer[j++] = temp[--i];
+  buffer[j] = '\0';
+  return buffer;
+}
+#endif
+
+#if BC127_ENABLE_AUDIO
 // One of the neat features of the BC127 is the ability to control an audio
 //  player remotely. This function will activate those features, programmatically.
 BC127::opResult BC127::musicCommands(audioCmds command)
+{
+  // The command strings are stored in the same order as the audioCmds enum,
+  //  so we can just offset into the string table.
+  if (command < PLAY || command > STOP) return INVALID_PARAM;
+  opResult result = simpleCmd((cmdStrings)(C_MUSIC_PLAY + command));
+  if (result == SUCCESS) noteMusic(command);
+  return result;
+}
+
+BC127::opResult BC127::musicCommandsAsync(audioCmds command)
+{
+  if (command < PLAY || command > STOP) return INVALID_PARAM;
+  cmdStart();
+  cmdAppend((cmdStrings)(C_MUSIC_PLAY + command));
+  opResult result = asyncSend(REPLY_OK, 3000);
+  _asyncMusic = command;
+  return result;
+}
+
+// Stepping the volume with musicCommands() costs a whole command per step;
+//  this goes straight to the level you want, from 0 to VOLUME_MAX.
+BC127::opResult BC127::setVolume(byte level)
+{
+  char levelStr[7];
+  
+  if (level > VOLUME_MAX) return INVALID_PARAM;
+  if (knownStart() != SUCCESS) return TIMEOUT_ERROR;
+  cmdStart();
+  cmdAppend(C_VOLUME);
+  cmdAppend(intToStr(level, levelStr));
+  opResult result = cmdSend(3000);
+  if (result == SUCCESS) _volume = level;
+  return result;
+}
+
+BC127::opResult BC127::setVolumeAsync(byte level)
+{
+  char levelStr[7];
+  
+  if (level > VOLUME_MAX) return INVALID_PARAM;
+  cmdStart();
+  cmdAppend(C_VOLUME);
+  cmdAppend(intToStr(level, levelStr));
+  opResult result = asyncSend(REPLY_OK, 3000);
+  _asyncVolume = level;
+  return result;
+}
+
+int BC127::volume()
+{
+  return _volume;
+}
+
+BC127::playStates BC127::playState()
+{
+  return (playStates)_playState;
+}
+
+// A music command that worked tells us something about the player: what it's
+//  now doing, or that the volume has moved one step (if we knew where it was
+//  to start with).
+void BC127::noteMusic(audioCmds command)
 {
   switch(command)
   {
-    case PAUSE:
-      return stdCmd("MUSIC PAUSE");
     case PLAY:
-      return stdCmd("MUSIC PLAY");
-    case FORWARD:
-      return stdCmd("MUSIC FORWARD");
-    case BACK:
-      return stdCmd("MUSIC BACKWARD");
+      _playState = PLAYING;
+      break;
+    case PAUSE:
+      _playState = PAUSED;
+      break;
     case STOP:
-      return stdCmd("MUSIC STOP");
+      _playState = STOPPED;
+      break;
     case UP:
-      return stdCmd("VOLUME UP");
+      if (_volume >= 0 && _volume < VOLUME_MAX) _volume++;
+      break;
     case DOWN:
-      return stdCmd("VOLUME DOWN");
+      if (_volume > 0) _volume--;
+      break;
     default:
-      return INVALID_PARAM;
+      break;
   }
 }
 
+// The module also tells us, unasked, when the player at the other end starts
+//  or stops, or when the remote device changes the volume. Every reply line
+//  passes through here on its way to parseReply(), so we keep up to date
+//  without sending anything.
+void BC127::noteEvent()
+{
+  if (lineStartsWith(F("AVRCP_PLAY")) || lineStartsWith(F("A2DP_STREAM_START")))
+    _playState = PLAYING;
+  else if (lineStartsWith(F("AVRCP_PAUSE")) ||
+           lineStartsWith(F("A2DP_STREAM_SUSPEND")))
+    _playState = PAUSED;
+  else if (lineStartsWith(F("AVRCP_STOP"))) _playState = STOPPED;
+  else if (lineStartsWith(F("ABS_VOL")))
+  {
+    // "ABS_VOL <link> <level>"; the level is the last number on the line, and
+    //  runs from 0 to 127, so it needs scaling down to our range.
+    byte end = _lineLen;
+    while (end > 0 && (_lineBuf[end-1] < '0' || _lineBuf[end-1] > '9')) end--;
+    byte start = end;
+    while (start > 0 && _lineBuf[start-1] >= '0' && _lineBuf[start-1] <= '9')
+      start--;
+    if (start == end || start < 8) return;
+    int level = atoi(_lineBuf + start);
+    if (level > 127) level = 127;
+    _volume = (level * VOLUME_MAX + 63) / 127;
+  }
+}
+
+// Look over anything that's come in since the last command, without waiting
+//  for more. If a non-blocking command is outstanding, asyncPoll() is doing
+//  this already. A line ending in "\r" is one we've already seen: the last
+//  reply to a blocking command, or an event we've already noted.
+void BC127::checkEvents()
+{
+  if (_asyncState != ASYNC_IDLE) return;
+  if (_linePrev == '\r') lineClear();
+  noteLines();
+}
+
 // In order to set the module as a source for streaming audio out to another
 //  device, you must set the "CLASSIC_ROLE" parameter to 1, then write/reset to
 //  make that setting active. This function handles this parameter setting.
 BC127::opResult BC127::setClassicSource()
 {
-  return stdSetParam("CLASSIC_ROLE", "1");
+  return setParam(C_CLASSIC_ROLE, C_ONE);
 }
 
 // Of course, we also need some way to return the module to sink mode, if we
 //  want to do that.
 BC127::opResult BC127::setClassicSink()
 {
-  return stdSetParam("CLASSIC_ROLE", "0");
+  return setParam(C_CLASSIC_ROLE, C_ZERO);
 }
+#endif
 
+#if BC127_ENABLE_BLE
 // BLEAdvertise() and BLENoAdvertise() turn advertising on and off for this
 //  module. Advertising must be turned on for another BLE device to detect the
 //  module, and the module *must* be a peripheral for advertising to work (see
 //  the "BLEPeripheral()" function.
 BC127::opResult BC127::BLEAdvertise()
 {
-  return stdCmd("ADVERTISING ON");
+  return simpleCmd(C_ADV_ON);
 }
 
 BC127::opResult BC127::BLENoAdvertise()
 {
-  return stdCmd("ADVERTISING OFF");
+  return simpleCmd(C_ADV_OFF);
 }
 
 // Scan is very similar to inquiry, but for BLE devices rather than for classic.
 //  Result format is slightly different, however- different enough to warrant
-//  another whole function, IMO.
+//  another whole reply type, IMO; see parseReply() for the details.
 BC127::opResult BC127::BLEScan(int timeout)
 {
-  // We're going to assume that what's going to happen is a timeout with no
-  //  valid input from the module.
-  int result = 0;
-  String buffer = "";
-  String addressTemp;
-  String EOL = String("\n\r");
-  
-  for (byte i = 0; i <5; i++) _addresses[i] = "";
-  _numAddresses = 0;
-    
-  knownStart();
-  
-  // Now issue the inquiry command.
-  _serialPort->print("SCAN "); _serialPort->print(timeout); _serialPort->print("\r");
-  _serialPort->flush();
-  
-  // We're going to use the internal timer to track the elapsed time since we
-  //  issued the command. Bog-standard Arduino stuff.
-  unsigned long loopStart = millis();
+  if (knownStart() != SUCCESS) return TIMEOUT_ERROR;
   
-  // Calculate a timeout value that's a tish longer than the module will
-  //  use. This is our catch-all, so we don't sit in this loop forever waiting
-  //  for input that will never come from the module.
-  unsigned long loopTimeout = timeout*1300;
-  
-  // Oooookaaaayyy...now the fun part. A state machine that parses the input
-  //  from the Bluetooth module!
-  while (loopStart + loopTimeout > millis())
-  {
-    // Grow the current buffered data, until we receive the EOL string.    
-    if (_serialPort->available() >0) buffer.concat(char(_serialPort->read()));
-    
-    // If we've received the EOL string, we should parse the current buffer
-    //  contents. There are three potential results to expect, here:
-    // "OK" - The module has finished scanning (timed out) and the results we
-    //   have are the only ones we'll ever get.
-    // "ERROR" - Something went wrong and we're not scanning.
-    //  SCAN <addr> <short_name> <role> <RSS>
-    //  <addr> is a 12-digit hex value
-    //  <short_name> is a string, surrounded by carets ( <like this> )
-    //  <role> is advertising flags. BC127 devices will show up as 0A; single mode
-    //    devices as 02.
-    //  <RSS> is the signal strength. Anything better than -70dBm is likely to be
-    //    quite okay for connecting.
-    if (buffer.endsWith(EOL))
-    {
-      if (buffer.startsWith("OK")) return (opResult)result;
-      if (buffer.startsWith("ER")) return MODULE_ERROR;
-      if (buffer.startsWith("SC")) // An address has been found!
-      {
-        addressTemp = buffer.substring(5,17);
-        buffer = "";
-        if (_numAddresses == 0) 
-        {
-          _addresses[0] = addressTemp;
-          _numAddresses++;
-          result = (opResult)1;
-        }
-        else // search the list for this address, and append if it's not in
-             //  the list and the list isn't too long.
-        {
-          for (char i = 0; i < _numAddresses; i++)
-          {
-            if (addressTemp == _addresses[i])
-            {
-              addressTemp = "x";
-              break;
-            }
-          }
-          if (addressTemp != "x")
-          {
-            _addresses[_numAddresses++] = addressTemp;
-            result++;
-          }
-          if (_numAddresses == 5) return (opResult)result;
-        }
-      }
-    }
-  }
-  return TIMEOUT_ERROR;
+  // Now issue the scan command, and collect the results.
+  addressCmd(C_SCAN, timeout);
+  cmdWrite();
+  return addressWait(REPLY_SCAN, timeout);
+}
+
+// Same again, without waiting; asyncPoll() returns the number of devices
+//  found, once the scan is over.
+BC127::opResult BC127::BLEScanAsync(int timeout)
+{
+  addressCmd(C_SCAN, timeout);
+  return asyncSend(REPLY_SCAN, timeout*1300UL);
 }
+#endif
 
+#if BC127_ENABLE_DATA_MODE
 BC127::opResult BC127::enterDataMode()
 {
-  return stdCmd("ENTER_DATA");
+  opResult result = simpleCmd(C_ENTER_DATA);
+  if (result == SUCCESS) _dataMode = true;
+  return result;
 }
 
 // Adequate to most situations, unless the user has adjust the CMD_TO value.
@@ -166,245 +229,220 @@ BC127::opResult BC127::enterDataMode()
 //  response. 
 BC127::opResult BC127::exitDataMode(int guardDelay)
 {
-  String buffer;
-  String EOL = String("\n\r"); // This is just handy.
-  
   delay(guardDelay);
   
-  _serialPort->print("$$$$");
-  _serialPort->flush();
+  // No "\r" on this one; the module watches for the bare escape sequence.
+  portWrite("$$$$", 4);
   
   // We're going to use the internal timer to track the elapsed time since we
   //  issued the command. Bog-standard Arduino stuff.
   unsigned long loopStart = millis();
   
   // This is our timeout loop. We'll give the module 2 seconds to exit data mode.
-  while (loopStart + 2000 > millis())
+  while (portReadLine(loopStart, 2000))
   {
-    // Grow the current buffered data, until we receive the EOL string.    
-    if (_serialPort->available() >0) buffer.concat(char(_serialPort->read()));
-
-    if (buffer.endsWith(EOL))
+    if (lineStartsWith(F("OK")))
     {
-      if (buffer.startsWith("OK")) return SUCCESS;
-      buffer = "";
-    }    
+      _dataMode = false;
+      return SUCCESS;
+    }
   }
   return TIMEOUT_ERROR;
 }
+#endif
 
+#if BC127_ENABLE_ADDRESS_TABLE
 // connect by index
 //  Attempts to connect to one of the Bluetooth devices which has an address
 //  stored in the _addresses array.
 BC127::opResult BC127::connect(char index, connType connection)
 {
-  if (index >= _numAddresses) return INVALID_PARAM;
+  if (index < 0 || index >= _numAddresses) return INVALID_PARAM;
   else return connect(_addresses[index], connection);
 }
+#endif
 
 // connect by address
 //  Attempts to connect to one of the Bluetooth devices which has an address
 //  stored in the _addresses array.
-BC127::opResult BC127::connect(String address, connType connection)
+BC127::opResult BC127::connect(const String &address, connType connection)
 {
-  // Before we go any further, we'll do a simple error check on the incoming
-  //  address. We know that it should be 12 hex digits, all uppercase; to
-  //  minimize execution time and code size, we'll only check that it's 12
-  //  characters in length.
-  if (address.length() != 12) return INVALID_PARAM;
+  return connect(address.c_str(), connection);
+}
 
-  // We need a buffer to store incoming data.
-  String buffer;
-  String EOL = String("\n\r"); // This is just handy.
-  
-  // Convert our connType enum into the actual string we need to send to the
-  //  BC127 module.
-  switch(connection)
-  {
-    case SPP:
-      buffer = " SPP";
-      break;
-    case BLE:
-      buffer = " BLE";
-      break;
-    case A2DP:
-      buffer = " A2DP";
-      break;
-    case AVRCP:
-      buffer = " AVRCP";
-      break;
-    case HFP:
-      buffer = " HFP";
-      break;
-    case PBAP:
-      buffer = " PBAP";
-      break;
-    default:
-      buffer = " SPP";
-      break;
-  }
+BC127::opResult BC127::connect(const char *address, connType connection)
+{
+  opResult result = openCmd(address, connection);
+  if (result != SUCCESS) return result;
   
-  knownStart(); // Purge serial buffers on both the module and the Arduino.
+  // Purge serial buffers on both the module and the Arduino.
+  if (knownStart() != SUCCESS) return TIMEOUT_ERROR;
   
-  // Now issue the inquiry command.
-  _serialPort->print("OPEN "); 
-  _serialPort->print(address);
-  _serialPort->print(buffer);
-  _serialPort->print("\r");
-  // We need to wait until the command finishes before we start looking for a
-  //  response; that's what flush() does.
-  _serialPort->flush();
+  // knownStart() used the line buffer, so we have to build the command again.
+  openCmd(address, connection);
+  // Now issue the inquiry command. portWrite() waits until the command
+  //  finishes before we start looking for a response.
+  cmdWrite();
   
   // We're going to use the internal timer to track the elapsed time since we
   //  issued the connect command. Bog-standard Arduino stuff.
   unsigned long connectStart = millis();
-  
-  buffer = "";
 
   // The timeout on this is 5 seconds; that may be a bit long.
-  while (connectStart + 5000 > millis())
+  while (portReadLine(connectStart, 5000))
   {
-    // Grow the current buffered data, until we receive the EOL string.    
-    if (_serialPort->available() >0) buffer.concat(char(_serialPort->read()));
-    
     // At some point, the BC127 response string will contain the EOL string.
-    //  Once that happens, we can figure out what the response looks like:
-    //  "ERROR" - there's a syntax error in your message to the module; this is
-    //    kind of unlikely, although it could happen if you call this function
-    //    with an invalid address (something not entirely uppercase hex digits)
-    //  "OPEN_ERROR" - most likely, the module can't find any devices with that
-    //    address.
-    //  "PAIR_ERROR" - the connection was refused by the remote module.
-    //  "PAIR_OK" - the connection has been made, but the SPP channel is not
-    //    yet open. We should probably just ignore this.
-    //  "OPEN_OK" - ready to rock! This is when we should return success.
-    if (buffer.endsWith(EOL))
-    {
-      if (buffer.startsWith("ERROR")) return MODULE_ERROR;
-      if (buffer.startsWith("OPEN_ERROR")) return CONNECT_ERROR;
-      if (buffer.startsWith("PAIR_ERROR")) return REMOTE_ERROR;
-      if (buffer.startsWith("OPEN_OK")) return SUCCESS;
-      buffer = "";    
-    }
+    //  Once that happens, we can figure out what the response looks like; see
+    //  parseReply() for the possibilities.
+    result = parseReply(REPLY_OPEN);
+    if (result == SUCCESS) notePeer(address, connection);
+    if (result != IN_PROGRESS) return result;
   }
   return TIMEOUT_ERROR;
 }
 
+// Same as above, but returns as soon as the command has been sent. Use
+//  asyncPoll() to find out how it went.
+BC127::opResult BC127::connectAsync(const char *address, connType connection)
+{
+  opResult result = openCmd(address, connection);
+  if (result != SUCCESS) return result;
+  strcpy(_asyncPeer, address);
+  _asyncProfile = connection;
+  return asyncSend(REPLY_OPEN, 5000);
+}
+
+// Build the OPEN command in the line buffer, checking the parameters on the
+//  way.
+BC127::opResult BC127::openCmd(const char *address, connType &connection)
+{
+  // Before we go any further, we'll do a simple error check on the incoming
+  //  address. We know that it should be 12 hex digits, all uppercase; to
+  //  minimize execution time and code size, we'll only check that it's 12
+  //  characters in length.
+  if (strlen(address) != 12) return INVALID_PARAM;
+
+  // The profile strings are stored in the same order as the connType enum;
+  //  anything else gets SPP. Profiles belonging to a feature that's been
+  //  compiled out are refused.
+  if (connection < SPP || connection > PBAP) connection = SPP;
+#if !BC127_ENABLE_BLE
+  if (connection == BLE) return INVALID_PARAM;
+#endif
+#if !BC127_ENABLE_AUDIO
+  if (connection != SPP && connection != BLE) return INVALID_PARAM;
+#endif
+  
+  cmdStart();
+  cmdAppend(C_OPEN);
+  cmdAppend(address);
+  cmdAppend((cmdStrings)(C_SPP + connection));
+  return SUCCESS;
+}
+
+#if BC127_ENABLE_CLASSIC_DISCOVERY
 // Runs the "INQUIRY" command, with user defined timeout. Returns the number of
-//  devices found, up to 5. The response expected looks like this:
-//    INQUIRY 20FABB010272 240404 -37db
-//    INQUIRY A4D1D203A4F4 6A041C -91db
-//    OK
-// "ERROR" is, as always, a possible result. What we want to do is extract that
-//  12-digit hex value and save it. We may get duplicates; we only want to keep
-//  new addresses. The parameter "timeout" is not in seconds; it can be between
-//  1 and 48 inclusive, and the timeout period will be 1.28*timeout. We'll set
-//  an internal timeout period that is slightly longer than that, for safety.
+//  devices found, up to 5; see parseReply() for what the module sends back.
+//  The parameter "timeout" is not in seconds; it can be between 1 and 48
+//  inclusive, and the timeout period will be 1.28*timeout. We'll set an
+//  internal timeout period that is slightly longer than that, for safety.
 BC127::opResult BC127::inquiry(int timeout)
 {
-
-  int result = 0;
-  String buffer = "";
-  String addressTemp;
-  String EOL = String("\n\r");
+  // Purge serial buffers on Arduino and module.
+  if (knownStart() != SUCCESS) return TIMEOUT_ERROR;
   
-  for (byte i = 0; i <5; i++) _addresses[i] = "";
-  _numAddresses = -1;
-    
-  knownStart(); // Purge serial buffers on Arduino and module.
+  // Now issue the inquiry command, and collect the results.
+  addressCmd(C_INQUIRY, timeout);
+  cmdWrite();
+  return addressWait(REPLY_INQUIRY, timeout);
+}
+
+BC127::opResult BC127::inquiryAsync(int timeout)
+{
+  addressCmd(C_INQUIRY, timeout);
+  return asyncSend(REPLY_INQUIRY, timeout*1300UL);
+}
+#endif
+
+#if BC127_ENABLE_ADDRESS_TABLE
+// Gets an address from the array of stored addresses. The return value allows
+//  the user to check on whether there was in fact a valid address at the
+//  requested index.
+BC127::opResult BC127::getAddress(char index, String &address)
+{
+  char temp[ADDR_LEN];
+  opResult result = getAddress(index, temp);
+  address = temp;
+  return result;
+}
+
+// Same again, but into a buffer that's at least ADDR_LEN characters long.
+BC127::opResult BC127::getAddress(char index, char *address)
+{
+  if (index < 0 || index+1 > _numAddresses)
+  {
+    address[0] = '\0';
+    return INVALID_PARAM;
+  }
+  else strcpy(address, _addresses[index]);
+  return SUCCESS;
+}
+
+// Inquiry and scan work the same way: clear out the address table, send the
+//  command with its timeout, then collect addresses until the module says
+//  it's done.
+void BC127::addressCmd(cmdStrings command, int timeout)
+{
+  char timeoutStr[7];
   
-  // Now issue the inquiry command.
-  _serialPort->print("INQUIRY "); 
-  _serialPort->print(timeout);
-  _serialPort->print("\r");
-  _serialPort->flush();
+  for (byte i = 0; i <5; i++) _addresses[i][0] = '\0';
+  _numAddresses = 0;
   
+  cmdStart();
+  cmdAppend(command);
+  cmdAppend(intToStr(timeout, timeoutStr));
+}
+
+BC127::opResult BC127::addressWait(replyTypes type, int timeout)
+{
   // We're going to use the internal timer to track the elapsed time since we
-  //  issued the inquiry. Bog-standard Arduino stuff.
+  //  issued the command. Bog-standard Arduino stuff.
   unsigned long loopStart = millis();
   
-  // Calculate a reset timeout value that's a tish longer than the module will
+  // Calculate a timeout value that's a tish longer than the module will
   //  use. This is our catch-all, so we don't sit in this loop forever waiting
   //  for input that will never come from the module.
-  unsigned long loopTimeout = timeout*1300;
+  unsigned long loopTimeout = timeout*1300UL;
   
-  // Oooookaaaayyy...now the fun part. A state machine that parses the input
-  //  from the Bluetooth module!
-  while (loopStart + loopTimeout > millis())
+  while (portReadLine(loopStart, loopTimeout))
   {
-    // Grow the current buffered data, until we receive the EOL string.    
-    if (_serialPort->available() >0) buffer.concat(char(_serialPort->read()));
-    
-    // If we've received the EOL string, we should parse the current buffer
-    //  contents. There are three potential results to expect, here:
-    // "OK" - The module has finished scanning (timed out) and the results we
-    //   have are the only ones we'll ever get.
-    // "ERROR" - Something went wrong and we're not scanning.
-    // "INQUIRY <addr> <class> <rss>" - A remote device has responded. <addr>
-    //   will be 12 upper case hex digits, and is the remote device's address,
-    //   to be used to refer to that device later on. <class> is the remote
-    //   device class; for example, by default, the BC127 will return 240404,
-    //   which corresponds to a Bluetooth headset. <rss> is the received signal
-    //   strength; generally, -70dBm is a good link strength.
-    if (buffer.endsWith(EOL))
-    {
-      if (buffer.startsWith("OK")) return (opResult)result;
-      if (buffer.startsWith("ER")) return MODULE_ERROR;
-      if (buffer.startsWith("IN")) // An address has been found!
-      {
-        // Nab the address from the received string and store it in addressTemp.
-        addressTemp = buffer.substring(8,20);
-        buffer = "";   // Clear the buffer for next round of data collection.
-        // If this is the first address, we need to do some things to ensure
-        //  that we get the right result value. If it's not first...
-        if (_numAddresses == -1) 
-        {
-          _addresses[0] = addressTemp;
-          _numAddresses = 1;
-          result = 1;
-        }
-        else // ...search the list for this address, and append if it's not in
-             //  the list and the list isn't too long.
-        {
-          // If we find it, change the addressTemp value to 'x'.
-          for (char i = 0; i <= _numAddresses; i++)
-          {
-            if (addressTemp == _addresses[i])
-            {
-              addressTemp = "x";
-              break;
-            }
-          }
-          // If we get here and the value isn't x, it was a new value, and can
-          //  be stored.
-          if (addressTemp != "x")
-          {
-            _addresses[_numAddresses++] = addressTemp;
-            result++;
-          }
-          // If we get HERE, our address list is full and we should return.
-          if (_numAddresses == 5) return (opResult)result;
-        }
-      }
-    }
+    opResult result = parseReply(type);
+    if (result != IN_PROGRESS) return result;
   }
   return TIMEOUT_ERROR;
 }
 
-// Gets an address from the array of stored addresses. The return value allows
-//  the user to check on whether there was in fact a valid address at the
-//  requested index.
-BC127::opResult BC127::getAddress(char index, String &address)
+// An address has been found! Nab it from the received line, at the given
+//  offset, and add it to the table if it's not already there. Once the table
+//  is full, there's no point in waiting for more, so we return the count;
+//  otherwise, IN_PROGRESS.
+BC127::opResult BC127::addressFound(byte offset)
 {
-  if (index+1 > _numAddresses)
+  if (_lineLen < offset + ADDR_LEN - 1) return IN_PROGRESS;
+  
+  for (char i = 0; i < _numAddresses; i++)
   {
-    String tempString = "";
-    address = tempString;
-    return INVALID_PARAM;
+    if (strncmp(_lineBuf + offset, _addresses[i], ADDR_LEN - 1) == 0)
+      return IN_PROGRESS;
   }
-  else address = _addresses[index];
-  return SUCCESS;
+  memcpy(_addresses[_numAddresses], _lineBuf + offset, ADDR_LEN - 1);
+  _addresses[_numAddresses][ADDR_LEN - 1] = '\0';
+  _numAddresses++;
+  
+  if (_numAddresses == 5) return (opResult)_numAddresses;
+  return IN_PROGRESS;
 }
+#endif
 
 // There are times when it is useful to be able to know whether or not the
 //  module is connected; this function will tell you whether or not the module
@@ -415,16 +453,12 @@ BC127::opResult BC127::getAddress(char index, String &address)
 //  and give up on identifying connections by type.
 BC127::opResult BC127::connectionState()
 {
-  String buffer;
-  String EOL = String("\n\r");
-  
-  opResult retVal = TIMEOUT_ERROR;
-  
-  knownStart();
+  if (knownStart() != SUCCESS) return TIMEOUT_ERROR;
   
-  _serialPort->print("STATUS");
-  _serialPort->print("\r");
-  _serialPort->flush();
+  cmdStart();
+  cmdAppend(C_STATUS);
+  cmdWrite();
+  _statusResult = TIMEOUT_ERROR;
   
   // We're going to use the internal timer to track the elapsed time since we
   //  issued the command. Bog-standard Arduino stuff.
@@ -435,76 +469,25 @@ BC127::opResult BC127::connectionState()
   //  software serial buffer. Working under this assumption, we're going to
   //  try and deal with both the overflow and no overflow case gracefully. I'm
   //  also removing the ability to check on a specific connection type, since
-  //  that's what causes the overflow.
-  while ((startTime + 500) > millis())
-  {  
-    // Grow the current buffered data, until we receive the EOL string.  
-    while (_serialPort->available() > 0) 
-    {
-      char temp = _serialPort->read();
-      buffer.concat(temp);
-      if (temp = '\r') break;
-    }  
-
-    // Parse the current line of text from the module and see what we find out.
-    if (buffer.endsWith(EOL))
-    {
-      // If the current line starts with "STATE", we need more parsing. This is
-      //  also the only guaranteed result.
-      if (buffer.startsWith("ST"))
-      {
-        // If "CONNECTED" is in the received string, we know we're connected,
-        //  but not if we're connected with the particular profile we're
-        //  interested in. So, we need to consider a bit further.
-        if (buffer.substring(13, 15) == "ED") retVal = SUCCESS;
-        // If "CONNECTED" *isn't* there, we want to return an appropriate error.
-        else retVal = CONNECT_ERROR;
-      }
-      // If we ARE connected, we'll get a list of different link types. We'll
-      //  want to parse over those and see if the profile we want is in it. If
-      //  it is, we can call it a success; if not, do nothing.
-      
-      // NB This is commented out, because we'll always overflow the soft serial
-      //  buffer if we have more than one type of connection open. I'm leaving
-      //  it in just in case somebody wants to use it in a "hardware-only" mode.
-      /*
-      if (buffer.startsWith("LI"))
-      {
-        switch(connection)
-        {
-          case SPP:
-            if (buffer.substring(17,19) == "SP") retVal = SUCCESS;
-            break;
-          case BLE:
-            if (buffer.substring(17,19) == "BL") retVal = SUCCESS;
-            break;
-          case A2DP:
-            if (buffer.substring(17,19) == "A2") retVal = SUCCESS;
-            break;
-          case HFP:
-            if (buffer.substring(17,19) == "HF") retVal = SUCCESS;
-            break;
-          case AVRCP:
-            if (buffer.substring(17,19) == "AV") retVal = SUCCESS;
-            break;
-          case PBAP:
-            if (buffer.substring(17,19) == "PB") retVal = SUCCESS;
-            break;
-          case ANY:
-          default:
-            break;
-        }
-      }
-      */
-      // If by some miracle we *do* get to this point without a buffer overflow,
-      //  we're safe to return without a buffer purge.
-      if (buffer.startsWith("OK")) return retVal;
-      buffer = "";
-    }
+  //  that's what causes the overflow. See parseReply() for the parsing.
+  while (portReadLine(startTime, 500))
+  {
+    // If by some miracle we *do* get to the "OK" without a buffer overflow,
+    //  we're safe to return without a buffer purge.
+    opResult result = parseReply(REPLY_STATUS);
+    if (result != IN_PROGRESS) return result;
   }
   // Okay, now we need to clean up our input buffer on the serial port. After
   //  all, we can be pretty sure that an overflow happened, and there's crap in
   //  the buffer.
-  while (_serialPort->available() > 0) _serialPort->read();
-  return retVal;
+  portPurge();
+  return _statusResult;
+}
+
+BC127::opResult BC127::connectionStateAsync()
+{
+  cmdStart();
+  cmdAppend(C_STATUS);
+  _statusResult = TIMEOUT_ERROR;
+  return asyncSend(REPLY_STATUS, 500);
 }